@@ -35,11 +35,18 @@ typedef struct plugin_t plugin_t;
 struct plugin_t {
     clap_plugin_t plugin;
     const clap_host_t *host;
+    // the hosts thread pool, when it provide one
+    const clap_host_thread_pool_t *hostPool;
+    // to tell the host about a new latency
+    const clap_host_latency_t *hostLatency;
     ImpulseLoader *r;
     std::string state;
+    uint32_t channels;
     bool isInited;
     bool guiIsCreated;
+    // the latency reported to the host, it change only in activate()
     uint32_t latency;
+    bool restartRequested;
     uint32_t width;
     uint32_t height;
 };
@@ -158,21 +165,19 @@ const clap_plugin_params_t params = {
 
 static uint32_t audio_ports_count(const clap_plugin_t*, bool is_input) {
     if (is_input) return 1; // 1 input
-    else return 1; // and 2 output
+    else return 1; // and 1 output
 }
 
-static bool audio_ports_get(const clap_plugin_t*, uint32_t index, bool is_input, clap_audio_port_info_t *info) {
+static bool audio_ports_get(const clap_plugin_t* plugin, uint32_t index, bool is_input, clap_audio_port_info_t *info) {
+    plugin_t *plug = (plugin_t *)plugin->plugin_data;
     if (index > 0) return false;
     info->id = index;
     snprintf(info->name, sizeof(info->name), "%s", is_input ? "Input" : "Output");
-    if (is_input) {
-        info->channel_count = 1; // Mono
-        info->port_type = CLAP_PORT_MONO;
-    } else {
-        info->channel_count = 1; // Stereo
-        info->port_type = CLAP_PORT_MONO;
-    }
+    // mono or stereo in and out
+    info->channel_count = plug->channels;
+    info->port_type = plug->channels == 2 ? CLAP_PORT_STEREO : CLAP_PORT_MONO;
     info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+    info->in_place_pair = CLAP_INVALID_ID;
     return true;
 }
 
@@ -187,14 +192,37 @@ static const clap_plugin_audio_ports_t audio_ports = {
 
 static uint32_t latency_get(const clap_plugin_t *plugin) {
     plugin_t *plug = (plugin_t *)plugin->plugin_data;
-    plug->r->getLatency(&plug->latency);
     return plug->latency;
 }
 
+// a new latency mode is reported on the restart, until then
+// the host compensate the old one
+static void latency_check(plugin_t *plug) {
+    uint32_t latency = 0;
+    plug->r->getLatency(&latency);
+    if (latency != plug->latency && !plug->restartRequested) {
+        plug->restartRequested = true;
+        plug->host->request_restart(plug->host);
+    }
+}
+
 static const clap_plugin_latency_t latency_extension = {
     .get = latency_get,
 };
 
+/****************************************************************
+ ** Thread pool, the host run the convolver tails
+ */
+
+static void thread_pool_exec(const clap_plugin_t *plugin, uint32_t task_index) {
+    plugin_t *plug = (plugin_t *)plugin->plugin_data;
+    plug->r->hostQueue.run(task_index);
+}
+
+static const clap_plugin_thread_pool_t thread_pool_extension = {
+    .exec = thread_pool_exec,
+};
+
 /****************************************************************
  ** save and load states
  */
@@ -361,8 +389,14 @@ static const clap_plugin_gui_t extensionGUI = {
 
 // Initialize the plugin
 static bool init(const clap_plugin_t *plugin) {
-    //plugin_t *plug = (plugin_t *)plugin->plugin_data;
+    plugin_t *plug = (plugin_t *)plugin->plugin_data;
     //plug->r->initEngine(48000, 25, 1);
+    plug->hostPool = (const clap_host_thread_pool_t *)
+        plug->host->get_extension(plug->host, CLAP_EXT_THREAD_POOL);
+    if (plug->hostPool && !plug->hostPool->request_exec) plug->hostPool = NULL;
+    plug->hostLatency = (const clap_host_latency_t *)
+        plug->host->get_extension(plug->host, CLAP_EXT_LATENCY);
+    if (plug->hostLatency && !plug->hostLatency->changed) plug->hostLatency = NULL;
     return true;
 }
 
@@ -416,8 +450,30 @@ static clap_process_status process(const clap_plugin_t *plugin, const clap_proce
     // in-place processing
     if(left_output != input)
         memcpy(left_output, input, nframes*sizeof(float));
-    
-    plug->r->process(nframes, left_output, left_output);
+
+    // the tails started in this call are run by the host thread pool,
+    // or by our own one when the host reject them
+    if (plug->hostPool) plug->r->hostQueue.open();
+    float *right_output = nullptr;
+    if (plug->channels == 2) {
+        // a host may give us less channels then requested
+        float *right_input = process->audio_inputs[0].channel_count > 1 ?
+            process->audio_inputs[0].data32[1] : input;
+        right_output = process->audio_outputs[0].channel_count > 1 ?
+            process->audio_outputs[0].data32[1] : nullptr;
+        if (right_output) {
+            if(right_output != right_input)
+                memcpy(right_output, right_input, nframes*sizeof(float));
+            plug->r->process(nframes, left_output, right_output, left_output, right_output);
+        }
+    }
+    if (!right_output) plug->r->process(nframes, left_output, left_output);
+    if (plug->hostPool) {
+        const uint32_t tasks = plug->r->hostQueue.close();
+        if (tasks && !plug->hostPool->request_exec(plug->host, tasks))
+            plug->r->hostQueue.release();
+    }
+    latency_check(plug);
     return CLAP_PROCESS_CONTINUE;
 }
 
@@ -427,9 +483,18 @@ static bool activate(const struct clap_plugin *plugin,
                              uint32_t                  min_frames_count,
                              uint32_t                  max_frames_count) {
     plugin_t *plug = (plugin_t *)plugin->plugin_data;
+    // the partitions are planned for the largest block we could get
+    plug->r->setBufferSize(max_frames_count);
     plug->r->initEngine(sample_rate, 25, 1);
     plug->isInited = true;
     if(!plug->state.empty()) plug->r->readState(plug->state);
+    uint32_t latency = 0;
+    plug->r->getLatency(&latency);
+    if (latency != plug->latency) {
+        plug->latency = latency;
+        if (plug->hostLatency) plug->hostLatency->changed(plug->host);
+    }
+    plug->restartRequested = false;
     return true;
 }
 
@@ -459,6 +524,20 @@ static const clap_plugin_descriptor_t descriptor = {
     .features = (const char *[]){ CLAP_PLUGIN_FEATURE_AUDIO_EFFECT, NULL },
 };
 
+// the stereo version, handle stereo and true stereo IR files
+static const clap_plugin_descriptor_t descriptorStereo = {
+    .clap_version = CLAP_VERSION_INIT,
+    .id = "com.brummer10.ImpulseLoaderStereo",
+    .name = "ImpulseLoader Stereo",
+    .vendor = "brummer10",
+    .url = "https://github.com/brummer10/ImpulseLoader",
+    .manual_url = "https://github.com/brummer10/ImpulseLoader",
+    .support_url = "https://github.com/brummer10/ImpulseLoader",
+    .version = "0.1.9",
+    .description = "CLAP plugin wrapper for ImpulseLoader Stereo",
+    .features = (const char *[]){ CLAP_PLUGIN_FEATURE_AUDIO_EFFECT, CLAP_PLUGIN_FEATURE_STEREO, NULL },
+};
+
 // Extensions
 static const void *get_extension(const clap_plugin_t *plugin, const char *id) {
     if (!strcmp(id, CLAP_EXT_AUDIO_PORTS)) return &audio_ports;
@@ -466,19 +545,22 @@ static const void *get_extension(const clap_plugin_t *plugin, const char *id) {
     if (!strcmp(id, CLAP_EXT_GUI)) return &extensionGUI;
     if (!strcmp(id, CLAP_EXT_PARAMS)) return &params;
     if (!strcmp(id, CLAP_EXT_STATE)) return &state_extension;
+    if (!strcmp(id, CLAP_EXT_THREAD_POOL)) return &thread_pool_extension;
     return NULL;
 }
 
 // Create the plugin
-static const clap_plugin_t *create(const clap_host_t *host) {
+static const clap_plugin_t *create(const clap_host_t *host, const clap_plugin_descriptor_t *desc) {
     plugin_t *plug = (plugin_t *)calloc(1, sizeof(plugin_t));
     if (!plug) return NULL;
     plug->r = new ImpulseLoader();
+    plug->channels = (desc == &descriptorStereo) ? 2 : 1;
+    plug->r->setChannels(plug->channels, plug->channels);
     plug->guiIsCreated = false;
     plug->isInited = false;
     plug->width = WINDOW_WIDTH;
     plug->height = WINDOW_HEIGHT;
-    plug->plugin.desc = &descriptor;
+    plug->plugin.desc = desc;
     plug->plugin.plugin_data = plug;
     plug->plugin.init = init;
     plug->plugin.destroy = destroy;
@@ -491,6 +573,10 @@ static const clap_plugin_t *create(const clap_host_t *host) {
     plug->plugin.get_extension = get_extension;
     plug->plugin.on_main_thread = on_main_thread;
     plug->host = host;
+    plug->hostPool = NULL;
+    plug->hostLatency = NULL;
+    plug->latency = 0;
+    plug->restartRequested = false;
     return &plug->plugin;
 }
 
@@ -499,12 +585,14 @@ static const clap_plugin_t *create(const clap_host_t *host) {
  */
 
 static uint32_t plugin_factory_get_plugin_count(const struct clap_plugin_factory *factory) {
-   return 1;
+   return 2;
 }
 
 static const clap_plugin_descriptor_t *plugin_factory_get_descriptor
                     (const struct clap_plugin_factory *factory, uint32_t index) {
-   return  &descriptor; //s_plugins[index].desc;
+   if (index == 1) return &descriptorStereo;
+   if (index == 0) return &descriptor;
+   return NULL;
 }
 
 static const clap_plugin_t *plugin_factory_create_neuralrack
@@ -514,7 +602,11 @@ static const clap_plugin_t *plugin_factory_create_neuralrack
    if (!clap_version_is_compatible(host->clap_version)) {
       return NULL;
    }
-   return create(host);
+   if (plugin_id && !strcmp(plugin_id, descriptorStereo.id))
+      return create(host, &descriptorStereo);
+   if (plugin_id && strcmp(plugin_id, descriptor.id))
+      return NULL;
+   return create(host, &descriptor);
 }
 
 static const clap_plugin_factory_t plugin_factory = {
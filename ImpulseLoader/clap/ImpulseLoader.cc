@@ -31,6 +31,8 @@ class ImpulseLoader
 public:
     Widget_t*               TopWin;
     Params                  param;
+    // the tail jobs of a process call, for the CLAP host thread pool
+    HostQueue               hostQueue;
 
     ImpulseLoader() : engine(), param() {
         workToDo.store(false, std::memory_order_release);
@@ -49,6 +51,7 @@ public:
         registerParameters();
         for(int i = 0;i<CONTROLS;i++)
             ui->widget[i] = NULL;
+        fprintf(stderr, "ImpulseLoader: using %s convolution kernels\n", simd::levelName());
     }
 
     ~ImpulseLoader() {
@@ -63,6 +66,13 @@ public:
         param.registerParam("Gain ",          "IR",    -20,20,0,0.1, (void*)&engine.plugin1->gain,     false, Is_FLOAT);
         param.registerParam("Wet/Dry",        "IR",    0,100,100,1,  (void*)&engine.plugin2->dry_wet,  false, Is_FLOAT);
         param.registerParam("Normalise",      "Global", 0,1,1,1,     (void*)&engine.normA,              true,  IS_UINT);
+        param.registerParam("Trim",           "Global", 0,1,0,1,     (void*)&engine.trimA,              true,  IS_UINT);
+        param.registerParam("Minimum Phase",  "Global", 0,1,0,1,     (void*)&engine.minphaseA,          true,  IS_UINT);
+        param.registerParam("IR Gain",        "IR",    -20,20,0,0.1, (void*)&engine.irGainA,            false, Is_FLOAT);
+        param.registerParam("Pre-Delay",      "IR",    0,500,0,1,    (void*)&engine.delayA,             false, Is_FLOAT);
+        param.registerParam("Offset",         "IR",    0,1000,0,1,   (void*)&engine.offsetA,            false, Is_FLOAT);
+        param.registerParam("Length",         "IR",    0,10000,0,10, (void*)&engine.lengthA,            false, Is_FLOAT);
+        param.registerParam("Latency",        "Global", 0,3,0,1,     (void*)&engine.latencyA,           true,  IS_UINT);
     }
 
     void startGui(Window window) {
@@ -182,8 +192,20 @@ public:
             engine._notify_ui.store(false, std::memory_order_release);
             X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
             get_file(engine.ir_file, &ps->ir);
+            ps->irLength = engine.irLength.load(std::memory_order_relaxed);
+            ps->irSaving = engine.irSaving.load(std::memory_order_relaxed);
             expose_widget(ui->win);
             engine._cd.store(0, std::memory_order_release);
+        } else {
+            // the missed deadlines are counted in the process thread
+            X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+            const float misses = static_cast<float>(engine.misses.load(std::memory_order_relaxed));
+            const float adaptations = static_cast<float>(engine.adaptations.load(std::memory_order_relaxed));
+            if (ps->misses != misses || ps->adaptations != adaptations) {
+                ps->misses = misses;
+                ps->adaptations = adaptations;
+                expose_widget(ui->win);
+            }
         }
     }
 
@@ -204,15 +226,43 @@ public:
     }
 
     void enableEngine(int on) {
-        adj_set_value(ui->widget[10]->adj, static_cast<float>(on));
+        adj_set_value(ui->widget[2]->adj, static_cast<float>(on));
+    }
+
+    // set the channel layout before initEngine()
+    void setChannels(uint32_t inputs, uint32_t outputs) {
+        engine.set_channels(inputs, outputs);
+    }
+
+    // the block size from the host, the partitions are planned for it
+    void setBufferSize(uint32_t size) {
+        engine.set_buffersize(size);
+    }
+
+    // plan the partitions again when the block size changed,
+    // the GUI may not run, so start the worker from here
+    inline void checkBlockSize() {
+        if (engine.replan()) {
+            engine._cd.store(1, std::memory_order_relaxed);
+            engine._execute.store(true, std::memory_order_release);
+            engine.xrworker.runProcess();
+        }
     }
 
     inline void process(uint32_t n_samples, float* output, float* output1) {
         engine.process(n_samples, output, output1);
+        checkBlockSize();
     }
 
+    inline void process(uint32_t n_samples, float* input0, float* input1,
+                        float* output0, float* output1) {
+        engine.process(n_samples, input0, input1, output0, output1);
+        checkBlockSize();
+    }
+
+    // the latency of the selected latency mode, the host is told on activate
     void getLatency(uint32_t* latency) {
-        (*latency) = 0;
+        (*latency) = engine.get_latency();
     }
 
     void getEngineValues() {
@@ -220,6 +270,13 @@ public:
         adj_set_value(ui->widget[1]->adj, engine.plugin2->dry_wet);
         adj_set_value(ui->widget[2]->adj, engine.bypass);
         adj_set_value(ui->widget[3]->adj, engine.normA);
+        adj_set_value(ui->widget[4]->adj, engine.trimA);
+        adj_set_value(ui->widget[5]->adj, engine.minphaseA);
+        adj_set_value(ui->widget[6]->adj, engine.irGainA);
+        adj_set_value(ui->widget[7]->adj, engine.delayA);
+        adj_set_value(ui->widget[8]->adj, engine.offsetA);
+        adj_set_value(ui->widget[9]->adj, engine.lengthA);
+        adj_set_value(ui->widget[10]->adj, engine.latencyA);
     }
 
     // send value changes from GUI to the engine
@@ -241,10 +298,47 @@ public:
             case 7:
                 engine.normA = static_cast<uint32_t>(value);
                 param.setParamDirty(3 , true);
+            break;
+            case 10:
+                engine.trimA = static_cast<uint32_t>(value);
+                param.setParamDirty(4 , true);
                 engine._cd.store(1, std::memory_order_relaxed);
-                engine.conv.set_normalisation(engine.normA);
                 workToDo.store(true, std::memory_order_release);
             break;
+            case 13:
+                engine.minphaseA = static_cast<uint32_t>(value);
+                param.setParamDirty(5 , true);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 14:
+                engine.irGainA = value;
+                param.setParamDirty(6 , true);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 15:
+                engine.delayA = value;
+                param.setParamDirty(7 , true);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 16:
+                engine.offsetA = value;
+                param.setParamDirty(8 , true);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 17:
+                engine.lengthA = value;
+                param.setParamDirty(9 , true);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 20:
+                engine.latencyA = static_cast<uint32_t>(value);
+                param.setParamDirty(10 , true);
+            break;
             default:
             break;
         }
@@ -310,8 +404,15 @@ public:
                 engine.bypass = static_cast<uint32_t>(check_stod(value));
                 buf >> value;
                 engine.normA = static_cast<uint32_t>(check_stod(value));
+                // not in states saved by older versions
+                if (buf >> value) engine.trimA = static_cast<uint32_t>(check_stod(value));
+                if (buf >> value) engine.minphaseA = static_cast<uint32_t>(check_stod(value));
+                if (buf >> value) engine.irGainA = check_stod(value);
+                if (buf >> value) engine.delayA = check_stod(value);
+                if (buf >> value) engine.offsetA = check_stod(value);
+                if (buf >> value) engine.lengthA = check_stod(value);
+                if (buf >> value) engine.latencyA = static_cast<uint32_t>(check_stod(value));
                 engine._cd.store(1, std::memory_order_relaxed);
-                engine.conv.set_normalisation(engine.normA);
             } else if (key.compare("[IrFile]") == 0) {
                 engine.ir_file = remove_sub(line, "[IrFile] ");
                 engine._cd.store(1, std::memory_order_relaxed);
@@ -339,6 +440,13 @@ public:
         buffer << engine.plugin2->dry_wet << " ";
         buffer << engine.bypass << " ";
         buffer << engine.normA << " ";
+        buffer << engine.trimA << " ";
+        buffer << engine.minphaseA << " ";
+        buffer << engine.irGainA << " ";
+        buffer << engine.delayA << " ";
+        buffer << engine.offsetA << " ";
+        buffer << engine.lengthA << " ";
+        buffer << engine.latencyA << " ";
         buffer << "|";
         buffer << "[IrFile] " << engine.ir_file << "|";
         (*state) = buffer.str();
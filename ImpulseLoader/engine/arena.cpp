@@ -0,0 +1,116 @@
+/*
+ * arena.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+
+/****************************************************************
+ ** ScratchArena
+ */
+
+// a new block is at least this large, in floats
+static constexpr size_t minBlock = 16384;
+
+float* ScratchArena::allocate(size_t count)
+{
+    void* p = nullptr;
+    #if defined(_WIN32)
+    p = _aligned_malloc(count * sizeof(float), ALIGN);
+    #else
+    if (posix_memalign(&p, ALIGN, count * sizeof(float)) != 0) p = nullptr;
+    #endif
+    return static_cast<float*>(p);
+}
+
+void ScratchArena::deallocate(float* data)
+{
+    #if defined(_WIN32)
+    _aligned_free(data);
+    #else
+    free(data);
+    #endif
+}
+
+bool ScratchArena::grow(size_t count)
+{
+    const size_t last = _blocks.empty() ? 0 : _blocks.back().size;
+    const size_t size = align(std::max(count, std::max(last, minBlock)));
+    float* data = allocate(size);
+    if (!data) return false;
+    _blocks.push_back({data, size, 0});
+    _current = _blocks.size() - 1;
+    return true;
+}
+
+bool ScratchArena::reserve(size_t count)
+{
+    count = align(count);
+    if (capacity() >= count && _blocks.size() == 1) return true;
+    if (_used) return false;
+    release();
+    float* data = allocate(count);
+    if (!data) return false;
+    _blocks.push_back({data, count, 0});
+    return true;
+}
+
+// the blocks are filled in order, a buffer which don't fit in the
+// rest of the current block start the next one
+float* ScratchArena::alloc(size_t count)
+{
+    count = align(std::max(count, static_cast<size_t>(1)));
+    while (_current < _blocks.size() &&
+           _blocks[_current].size - _blocks[_current].fill < count) {
+        _current++;
+    }
+    if (_current >= _blocks.size() && !grow(count)) return nullptr;
+    Block& b = _blocks[_current];
+    float* p = b.data + b.fill;
+    b.fill += count;
+    _used += count;
+    _peak = std::max(_peak, _used);
+    memset(p, 0, count * sizeof(float));
+    return p;
+}
+
+void ScratchArena::rewind()
+{
+    if (_blocks.size() > 1) {
+        const size_t peak = _peak;
+        _used = 0;
+        release();
+        reserve(peak);
+    }
+    for (Block& b : _blocks) b.fill = 0;
+    _current = 0;
+    _used = 0;
+    _peak = 0;
+}
+
+void ScratchArena::release()
+{
+    for (Block& b : _blocks) deallocate(b.data);
+    _blocks.clear();
+    _current = 0;
+    _used = 0;
+    _peak = 0;
+}
+
+size_t ScratchArena::capacity() const
+{
+    size_t size = 0;
+    for (const Block& b : _blocks) size += b.size;
+    return size;
+}
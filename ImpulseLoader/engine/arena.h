@@ -0,0 +1,76 @@
+/*
+ * arena.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+/****************************************************************
+ ** ScratchArena - the buffers used in the process thread, handed out
+ *                 from large 64 byte aligned blocks, each buffer start
+ *                 on a cache line. The blocks are allocated in init()
+ *                 and kept on a reload, so the next IR with the same
+ *                 layout need no new memory. The process thread only use
+ *                 the buffers, it never call any of the functions here.
+ */
+
+class ScratchArena
+{
+public:
+    static constexpr size_t ALIGN = 64;
+
+    // make room for count floats in one block, before the first alloc()
+    bool reserve(size_t count);
+    // count floats set to zero, nullptr when there is no memory left
+    float* alloc(size_t count);
+    // hand back all buffers, the memory is kept. The blocks used since
+    // the last rewind() are merged into one large enough for all of them.
+    void rewind();
+    // free the memory
+    void release();
+
+    // the floats in the blocks, and handed out since the last rewind()
+    size_t capacity() const;
+    inline size_t used() const { return _used;}
+
+    // count rounded up to full cache lines
+    static inline size_t align(size_t count) {
+        const size_t n = ALIGN / sizeof(float);
+        return (count + n - 1) / n * n;
+    }
+
+    ScratchArena() : _current(0), _used(0), _peak(0) {}
+    ~ScratchArena() { release();}
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+private:
+    struct Block {
+        float* data;
+        size_t size;
+        size_t fill;
+    };
+
+    std::vector<Block> _blocks;
+    size_t _current;
+    size_t _used;
+    size_t _peak;
+
+    bool grow(size_t count);
+    static float* allocate(size_t count);
+    static void deallocate(float* data);
+};
+
+#endif  // ARENA_H_
@@ -34,6 +34,8 @@
  #endif //__SSE3__
 #endif //__SSE__
 
+#include "simd.h"
+#include "arena.h"
 #include "dry_wet.cc"
 #include "gain.cc"
 
@@ -86,11 +88,59 @@ public:
     inline ~DenormalProtection() {};
 };
 
+/////////////////////////// GAIN RAMP   //////////////////////
+
+// a gain moving linear to it's target within the ramp length, with one
+// slope per block, so it's applied by the vector kernels
+struct Ramp {
+    float    value;
+    float    target;
+    float    step;
+    uint32_t left;
+    uint32_t length;
+
+    inline void init(uint32_t length_, float v) {
+        length = std::max(length_, 1U);
+        reset(v);
+    }
+    inline void reset(float v) {
+        value = target = v;
+        step = 0.0f;
+        left = 0;
+    }
+    inline void set(float t) {
+        if (t == target) return;
+        target = t;
+        left = length;
+        step = (target - value) / static_cast<float>(length);
+    }
+    inline bool at(float v) const { return !left && value == v;}
+    // output = input * gain
+    inline void gain(float* output, const float* input, uint32_t n) const {
+        const uint32_t k = std::min(n, left);
+        if (k) simd::ramp(output, input, value, step, k);
+        if (k < n) simd::scale(output + k, input + k, target, n - k);
+    }
+    // output = a + gain * (b - a)
+    inline void fade(float* output, const float* a, const float* b, uint32_t n) const {
+        const uint32_t k = std::min(n, left);
+        if (k) simd::fade(output, a, b, value, step, k);
+        if (k < n) simd::fade(output + k, a + k, b + k, target, 0.0f, n - k);
+    }
+    inline void advance(uint32_t n) {
+        const uint32_t k = std::min(n, left);
+        left -= k;
+        value = left ? value + step * static_cast<float>(k) : target;
+    }
+};
+
 class Engine
 {
 public:
-    ParallelThread               xrworker;
-    ConvolverSelector            conv;
+    // the IR loading job, run by the shared ThreadPool
+    PoolJob                      xrworker;
+    // the gain in dB and the dry/wet mix in %, the values are
+    // applied smoothed by the engine
     gain::Dsp*                   plugin1;
     wet_dry::Dsp*                plugin2;
 
@@ -98,46 +148,246 @@ public:
     int32_t                      rt_policy;
     uint32_t                     s_rate;
     uint32_t                     bypass;
-    uint32_t                     bufsize;
+    // the host block size the partitions are planned for
+    std::atomic<uint32_t>        bufsize;
     uint32_t                     normA;
+    uint32_t                     trimA;
+    uint32_t                     minphaseA;
+    // the latency mode, 0 zero latency, 1 - 3 for 256, 512 or 1024 samples
+    uint32_t                     latencyA;
+    // the IR gain in dB, the pre-delay, start offset and length in ms,
+    // a length of 0 use the IR up to the end
+    float                        irGainA;
+    float                        delayA;
+    float                        offsetA;
+    float                        lengthA;
 
     std::string                  ir_file;
 
     std::atomic<bool>            _execute;
     std::atomic<bool>            _notify_ui;
     std::atomic<int>             _cd;
+    // the loaded IR length in ms and the CPU saved by shaping it in %
+    std::atomic<float>           irLength;
+    std::atomic<float>           irSaving;
+    // the blocks which missed there deadline, in the background tail or
+    // in the process thread, and how often the engine reacted to it
+    std::atomic<uint32_t>        misses;
+    std::atomic<uint32_t>        adaptations;
 
     inline Engine();
     inline ~Engine();
 
     inline void init(uint32_t rate, int32_t rt_prio_, int32_t rt_policy_);
+    // set the channel layout (1/1, 1/2 or 2/2) before init()
+    inline void set_channels(uint32_t inputs, uint32_t outputs);
+    // the nominal block size from the host, when known. A change of it
+    // could be told from any thread, the IR is then planned again
+    // in the background and swapped in without a gap.
+    inline void set_buffersize(uint32_t size);
+    // true when the loaded IR should be planned again for the block size,
+    // or with a fallback plan after missed deadlines
+    inline bool replan();
+    // the latency in samples for the latency mode, to report to the host
+    inline uint32_t get_latency() const;
     inline void clean_up();
     inline void do_work_mono();
     inline void process(uint32_t n_samples, float* output0, float* output1);
+    inline void process(uint32_t n_samples, float* input0, float* input1,
+                        float* output0, float* output1);
 
 private:
     DenormalProtection           MXCSR;
-    std::condition_variable      Sync;
-    std::mutex                   WMutex;
-
-    inline void setIRFile(ConvolverSelector *co, std::string *file);
+    uint32_t                     channelsIn;
+    uint32_t                     channelsOut;
+    // convolver slots, one is active in the process thread, one may fade out,
+    // the third one is free to be prepared by the worker thread
+    ConvolverSelector            conv[3];
+    // packed slot state: active | fading << 2 | pending << 4
+    std::atomic<uint32_t>        slots;
+    // the block size the active convolver was planned for, 0 without a IR
+    std::atomic<uint32_t>        planSize;
+    uint32_t                     fadeLength;
+    // the input gain with the normalisation, the wet part of the mix
+    // and the crossfade from the old convolver to the new one
+    Ramp                         inGain;
+    Ramp                         wetGain;
+    Ramp                         fade;
+    // a convolver planned again for a new block size start without
+    // the input history, so it run along with the old one for the IR
+    // length before the crossfade. The samples for each slot, and the
+    // samples left for the active one.
+    std::atomic<uint32_t>        slotWarmup[3];
+    uint32_t                     warmup;
+    // the settings of the IR in each slot, to tell a new plan from
+    // a new IR. The crossfade start from the active slot, a prepared
+    // one replaced before the pickup don't count. [worker thread]
+    std::string                  slotKey[3];
+    // the reaction on missed deadlines requested by the process thread
+    std::atomic<uint32_t>        adapt;
+    // the ConvPlan fallback and how often the IR is cut in half, for fallbackFile
+    std::atomic<uint32_t>        fallback;
+    std::atomic<uint32_t>        shorten;
+    std::string                  fallbackFile;
+    // the clean seconds before a adaptation is taken back, doubled when
+    // the engine had to react again after that. [worker thread]
+    std::atomic<uint32_t>        recoverTime;
+    bool                         recovered;
+    // the misses counted within the last second, and the
+    // seconds in a row with to many misses or without any
+    uint32_t                     recentMisses;
+    uint32_t                     recentOverruns;
+    uint32_t                     loadTime;
+    uint32_t                     badSeconds;
+    uint32_t                     cleanSeconds;
+    // the samples after a swap in which the misses don't count for the adaptation
+    uint32_t                     settle;
+
+    static constexpr uint32_t    NOSLOT = 3;
+    // the buffers below are sized for the host block size, at least for
+    // a FIFO block, larger blocks are processed in parts of chunkSize.
+    // Without a size from the host DEFCHUNK is used. A larger block size is set up by the worker thread
+    // in the other scratch and handed over to the process thread, the old
+    // one is only reused when the process thread is done with it.
+    static constexpr uint32_t    DEFCHUNK = 1024;
+    static constexpr uint32_t    MAXCHUNK = 8192;
+    static constexpr uint32_t    NOSCRATCH = 2;
+    struct Scratch {
+        ScratchArena             arena;
+        uint32_t                 size;
+        float*                   dryBuf[2];
+        float*                   fadeBuf[2];
+        float*                   fifoIn[2];
+        float*                   fifoOut[2];
+    };
+    Scratch                      scratch[2];
+    // the scratch used by the process thread, the one handed to it
+    // and the last one handed over [worker thread]
+    std::atomic<uint32_t>        scratchUsed;
+    std::atomic<uint32_t>        scratchNext;
+    uint32_t                     scratchOffered;
+    uint32_t                     chunkSize;
+    // the dry signal when the input is overwritten, and the old convolvers output
+    float*                       dryBuf[2];
+    float*                       fadeBuf[2];
+    // with a latency the host blocks are collected in the input FIFO and
+    // processed in blocks of the latency into the output FIFO
+    static constexpr uint32_t    MAXLATENCY = 1024;
+    std::atomic<uint32_t>        latency;
+    float*                       fifoIn[2];
+    float*                       fifoOut[2];
+    uint32_t                     fifoPos;
+    // the time, the samples and the tail misses of the host calls
+    // since the last FIFO block, the load is checked per FIFO block
+    uint64_t                     fifoTime;
+    uint32_t                     fifoSamples;
+    uint32_t                     fifoMisses;
+    enum {
+        ADAPT_NONE,
+        ADAPT_TAIL,         // the background tail missed it's deadline
+        ADAPT_LOAD,         // the convolution took longer then the block
+        ADAPT_RECOVER       // no misses for recoverTime, take the last one back
+    };
+    // a second with MISSLIMIT misses is overloaded,
+    // the engine react after BADSECONDS of them in a row
+    static constexpr uint32_t    MISSLIMIT = 3;
+    static constexpr uint32_t    BADSECONDS = 2;
+    // the clean seconds before the first step back, and the max of them
+    static constexpr uint32_t    RECOVERTIME = 30;
+    static constexpr uint32_t    MAXRECOVER = 480;
+    static constexpr uint32_t    MAXSHORTEN = 3;
+    static inline uint32_t slotActive(uint32_t s) { return s & 3;}
+    static inline uint32_t slotFading(uint32_t s) { return (s >> 2) & 3;}
+    static inline uint32_t slotPending(uint32_t s) { return (s >> 4) & 3;}
+    static inline uint32_t makeSlots(uint32_t a, uint32_t f, uint32_t p) {
+        return a | (f << 2) | (p << 4);}
+
+    inline uint32_t getFreeSlot();
+    inline void publishSlot(uint32_t slot);
+    inline uint32_t pickupSlot();
+    inline uint32_t retireFading(uint32_t s);
+    inline bool setupScratch(Scratch& sc, uint32_t size);
+    inline void growScratch(uint32_t size);
+    inline void pickupScratch();
+    inline uint32_t processChunk(uint32_t n, float* const* input, float* const* output,
+                                 uint32_t chans, uint32_t s);
+    inline uint32_t convolve(uint32_t n_samples, float* const* input, float* const* output,
+                             uint32_t chans);
+    inline void run(uint32_t n_samples, float* const* input, float* const* output, uint32_t chans);
+    inline uint32_t planBlock();
+    inline void setIRFile(std::string *file);
+    inline void setIrInfo(ConvolverSelector *co);
+    inline void setFallback(const std::string& file);
+    inline void checkLoad(uint32_t tailMisses, uint64_t time, uint32_t n_samples);
+    inline float normGain(ConvolverSelector *co);
+    inline unsigned int toSamples(float ms);
 };
 
 inline Engine::Engine() :
-    xrworker(), 
+    xrworker(ThreadPool::BACKGROUND), 
     plugin1(gain::plugin()),
     plugin2(wet_dry::plugin()) {
+        channelsIn = 1;
+        channelsOut = 1;
         bypass = 0;
-        bufsize = 0;
         normA = 0;
+        trimA = 0;
+        minphaseA = 0;
+        latencyA = 0;
+        irGainA = 0.0f;
+        delayA = 0.0f;
+        offsetA = 0.0f;
+        lengthA = 0.0f;
         ir_file = "None";
-        xrworker.start();
+        irLength.store(0.0f, std::memory_order_relaxed);
+        irSaving.store(0.0f, std::memory_order_relaxed);
+        misses.store(0, std::memory_order_relaxed);
+        adaptations.store(0, std::memory_order_relaxed);
+        adapt.store(ADAPT_NONE, std::memory_order_relaxed);
+        fallback.store(ConvPlan::FALLBACK_NONE, std::memory_order_relaxed);
+        shorten.store(0, std::memory_order_relaxed);
+        recoverTime.store(RECOVERTIME, std::memory_order_relaxed);
+        recovered = false;
+        recentMisses = 0;
+        recentOverruns = 0;
+        loadTime = 0;
+        badSeconds = 0;
+        cleanSeconds = 0;
+        settle = 0;
+        fadeLength = 1;
+        warmup = 0;
+        for (uint32_t i = 0; i < 3; i++) slotWarmup[i].store(0, std::memory_order_relaxed);
+        bufsize.store(0, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < 2; i++) scratch[i].size = 0;
+        scratchUsed.store(0, std::memory_order_relaxed);
+        scratchNext.store(NOSCRATCH, std::memory_order_relaxed);
+        scratchOffered = 0;
+        chunkSize = 0;
+        dryBuf[0] = dryBuf[1] = nullptr;
+        fadeBuf[0] = fadeBuf[1] = nullptr;
+        fifoIn[0] = fifoIn[1] = nullptr;
+        fifoOut[0] = fifoOut[1] = nullptr;
+        fifoPos = 0;
+        fifoTime = 0;
+        fifoSamples = 0;
+        fifoMisses = 0;
+        latency.store(0, std::memory_order_relaxed);
+        inGain.init(1, 0.0f);
+        wetGain.init(1, 1.0f);
+        fade.init(1, 1.0f);
+        slots.store(makeSlots(0, NOSLOT, NOSLOT), std::memory_order_release);
+        planSize.store(0, std::memory_order_release);
+        simd::init();
+        ThreadPool::instance().acquire();
 };
 
 inline Engine::~Engine(){
     xrworker.stop();
-    conv.stop_process();
-    conv.cleanup();
+    for (int i = 0; i < 3; i++) {
+        conv[i].stop_process();
+        conv[i].cleanup();
+    }
+    ThreadPool::instance().release();
     plugin1->del_instance(plugin1);
     plugin2->del_instance(plugin2);
 };
@@ -149,45 +399,281 @@ inline void Engine::init(uint32_t rate, int32_t rt_prio_, int32_t rt_policy_) {
 
     rt_prio = rt_prio_;
     rt_policy = rt_policy_;
+    // 20ms crossfade when switching the IR, and to smooth the gains,
+    // the input fade in on start
+    fadeLength = std::max(1, static_cast<int>(rate * 0.02));
+    inGain.init(fadeLength, 0.0f);
+    wetGain.init(fadeLength, 1.0f);
+    fade.init(fadeLength, 1.0f);
+    // the process thread don't run here, so the buffers are taken at once
+    const uint32_t size = bufsize.load(std::memory_order_acquire);
+    growScratch(size ? size : DEFCHUNK);
+    pickupScratch();
+    fifoPos = 0;
+    latency.store(0, std::memory_order_release);
 
     _execute.store(false, std::memory_order_release);
     _notify_ui.store(false, std::memory_order_release);
     _cd.store(0, std::memory_order_release);
 
-    xrworker.setThreadName("Worker");
     xrworker.set<Engine, &Engine::do_work_mono>(this);
 };
 
+inline void Engine::set_channels(uint32_t inputs, uint32_t outputs) {
+    channelsIn = std::min(std::max(inputs, 1U), 2U);
+    channelsOut = std::min(std::max(outputs, 1U), 2U);
+}
+
+inline void Engine::set_buffersize(uint32_t size) {
+    if (size) bufsize.store(size, std::memory_order_release);
+}
+
+inline bool Engine::setupScratch(Scratch& sc, uint32_t size) {
+    sc.size = 0;
+    sc.arena.rewind();
+    sc.arena.reserve(4 * ScratchArena::align(size) + 4 * MAXLATENCY);
+    for (uint32_t c = 0; c < 2; c++) {
+        sc.dryBuf[c] = sc.arena.alloc(size);
+        sc.fadeBuf[c] = sc.arena.alloc(size);
+        sc.fifoIn[c] = sc.arena.alloc(MAXLATENCY);
+        sc.fifoOut[c] = sc.arena.alloc(MAXLATENCY);
+        if (!sc.dryBuf[c] || !sc.fadeBuf[c] || !sc.fifoIn[c] || !sc.fifoOut[c]) return false;
+    }
+    sc.size = size;
+    return true;
+}
+
+// the buffers only grow, so a smaller block size from the host keep
+// the memory used before. A scratch which wasn't picked up yet is
+// taken back, a taken one is only free when the process thread
+// switched to it. [worker thread]
+inline void Engine::growScratch(uint32_t size) {
+    size = std::min(std::max(size, MAXLATENCY), MAXCHUNK);
+    uint32_t next = scratchNext.exchange(NOSCRATCH, std::memory_order_acq_rel);
+    if (next == NOSCRATCH) {
+        while (scratchUsed.load(std::memory_order_acquire) != scratchOffered)
+            std::this_thread::yield();
+        if (size <= scratch[scratchOffered].size) return;
+        next = scratchOffered ^ 1;
+    } else if (size <= scratch[next].size) {
+        scratchNext.store(next, std::memory_order_release);
+        return;
+    }
+    if (!setupScratch(scratch[next], size)) {
+        // keep the old buffers
+        scratchOffered = scratchUsed.load(std::memory_order_acquire);
+        return;
+    }
+    scratchOffered = next;
+    scratchNext.store(next, std::memory_order_release);
+}
+
+// switch to the buffers handed over by the worker thread,
+// the FIFOs go on in the new ones [process thread]
+inline void Engine::pickupScratch() {
+    if (scratchNext.load(std::memory_order_relaxed) == NOSCRATCH) return;
+    const uint32_t next = scratchNext.exchange(NOSCRATCH, std::memory_order_acq_rel);
+    if (next == NOSCRATCH) return;
+    Scratch& sc = scratch[next];
+    for (uint32_t c = 0; c < 2; c++) {
+        if (fifoIn[c]) {
+            memcpy(sc.fifoIn[c], fifoIn[c], MAXLATENCY * sizeof(float));
+            memcpy(sc.fifoOut[c], fifoOut[c], MAXLATENCY * sizeof(float));
+        }
+        dryBuf[c] = sc.dryBuf[c];
+        fadeBuf[c] = sc.fadeBuf[c];
+        fifoIn[c] = sc.fifoIn[c];
+        fifoOut[c] = sc.fifoOut[c];
+    }
+    chunkSize = sc.size;
+    scratchUsed.store(next, std::memory_order_release);
+}
+
+// a larger block then planned for was seen by process(), the host
+// told a new block size, the latency mode changed or the process thread
+// missed deadlines, the wrapper then let the worker set up the IR again
+inline bool Engine::replan() {
+    const uint32_t p = planSize.load(std::memory_order_acquire);
+    return p && (p != planBlock() || adapt.load(std::memory_order_acquire)) &&
+           !_execute.load(std::memory_order_acquire);
+}
+
+inline uint32_t Engine::get_latency() const {
+    return latencyA ? 256U << (std::min(latencyA, 3U) - 1) : 0;
+}
+
+// the convolver see blocks of the latency, or the host blocks
+inline uint32_t Engine::planBlock() {
+    const uint32_t l = latency.load(std::memory_order_acquire);
+    return l ? l : bufsize.load(std::memory_order_acquire);
+}
+
 void Engine::clean_up()
 {
 }
 
-inline void Engine::setIRFile(ConvolverSelector *co, std::string *file) {
-    if (co->is_runnable()) {
-        co->set_not_runnable();
-        co->stop_process();
-        std::unique_lock<std::mutex> lk(WMutex);
-        Sync.wait_for(lk, std::chrono::milliseconds(160));
+// get a slot which isn't in use by the process thread,
+// take back a prepared slot which wasn't picked up yet
+inline uint32_t Engine::getFreeSlot() {
+    uint32_t s = slots.load(std::memory_order_acquire);
+    uint32_t n;
+    do {
+        n = makeSlots(slotActive(s), slotFading(s), NOSLOT);
+    } while (!slots.compare_exchange_weak(s, n, std::memory_order_acq_rel));
+    // retire the slots the process thread is done with
+    uint32_t slot = NOSLOT;
+    for (uint32_t i = 0; i < 3; i++) {
+        if (i == slotActive(n) || i == slotFading(n)) continue;
+        conv[i].stop_process();
+        conv[i].cleanup();
+        if (slot == NOSLOT) slot = i;
+    }
+    return slot;
+}
+
+// hand over a prepared slot to the process thread
+inline void Engine::publishSlot(uint32_t slot) {
+    uint32_t s = slots.load(std::memory_order_acquire);
+    uint32_t n;
+    do {
+        n = makeSlots(slotActive(s), slotFading(s), slot);
+    } while (!slots.compare_exchange_weak(s, n, std::memory_order_acq_rel));
+}
+
+// the cost of the convolution scale with the count of partitions,
+// so estimate the saving from the partitions the removed samples would fill
+inline void Engine::setIrInfo(ConvolverSelector *co) {
+    const uint32_t len = co ? co->get_ir_length() : 0;
+    const uint32_t src = co ? co->get_source_length() : 0;
+    float saving = 0.0f;
+    if (len && src > len) {
+        uint32_t part = 64;
+        while (part < planBlock()) part *= 2;
+        saving = 100.0f * (1.0f - static_cast<float>((len + part - 1) / part) /
+                                  static_cast<float>((src + part - 1) / part));
+    }
+    irLength.store(len ? 1000.0f * len / s_rate : 0.0f, std::memory_order_relaxed);
+    irSaving.store(saving, std::memory_order_relaxed);
+}
+
+// the IR is prepared for both normalisation modes,
+// so switching it is only a gain change, no reload
+inline float Engine::normGain(ConvolverSelector *co) {
+    return co->get_normalisation(normA);
+}
+
+inline unsigned int Engine::toSamples(float ms) {
+    return static_cast<unsigned int>(std::max(0.0f, ms) * 0.001f * s_rate + 0.5f);
+}
+
+// a missed tail move the tail to a larger partition first, then into the
+// process thread. When the process thread itself run out of time, the IR
+// is cut in half. After recoverTime without misses the last step is taken
+// back, the IR length first. When that overload the engine again, the
+// next step back wait twice as long. A new IR-File start again with the
+// planned layout.
+inline void Engine::setFallback(const std::string& file) {
+    if (file != fallbackFile) {
+        fallbackFile = file;
+        fallback.store(ConvPlan::FALLBACK_NONE, std::memory_order_relaxed);
+        shorten.store(0, std::memory_order_relaxed);
+        recoverTime.store(RECOVERTIME, std::memory_order_relaxed);
+        recovered = false;
+    }
+    const uint32_t a = adapt.load(std::memory_order_acquire);
+    if (a == ADAPT_NONE || file == "None") return;
+    const uint32_t f = fallback.load(std::memory_order_relaxed);
+    const uint32_t c = shorten.load(std::memory_order_relaxed);
+    if (a == ADAPT_RECOVER) {
+        if (c) {
+            shorten.store(c - 1, std::memory_order_relaxed);
+            fprintf(stderr, "ImpulseLoader: no misses, use 1/%i of the IR\n", 1 << (c - 1));
+        } else if (f) {
+            fallback.store(f - 1, std::memory_order_relaxed);
+            fprintf(stderr, "ImpulseLoader: no misses, %s\n",
+                f - 1 == ConvPlan::FALLBACK_NONE ? "use the planned tail partition" :
+                                                   "process the tail in the background");
+        } else {
+            return;
+        }
+        recovered = true;
+        adaptations.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (recovered) {
+        recoverTime.store(std::min(recoverTime.load(std::memory_order_relaxed) * 2, MAXRECOVER),
+                          std::memory_order_relaxed);
+        recovered = false;
+    }
+    if (a == ADAPT_TAIL && f < ConvPlan::FALLBACK_MAX) {
+        fallback.store(f + 1, std::memory_order_relaxed);
+        fprintf(stderr, "ImpulseLoader: tail missed the deadline, %s\n",
+            f + 1 == ConvPlan::FALLBACK_TAIL ? "use a larger tail partition" :
+                                               "process the tail in the audio thread");
+    } else if (c < MAXSHORTEN) {
+        shorten.store(c + 1, std::memory_order_relaxed);
+        fprintf(stderr, "ImpulseLoader: out of time, cut the IR to 1/%i\n", 1 << (c + 1));
+    } else {
+        return;
     }
+    adaptations.fetch_add(1, std::memory_order_relaxed);
+}
 
-    co->cleanup();
+// the IR data and the partition spectra come from the cache, so changing
+// the gain, pre-delay, offset or length don't reload the IR-File
+inline void Engine::setIRFile(std::string *file) {
+    const uint32_t slot = getFreeSlot();
+    ConvolverSelector *co = &conv[slot];
+    const uint32_t size = planBlock();
+    // the host block is processed as a whole, when the buffers could hold it
+    growScratch(bufsize.load(std::memory_order_acquire));
+    const uint32_t a = adapt.load(std::memory_order_acquire);
+    const bool adapting = a == ADAPT_TAIL || a == ADAPT_LOAD;
+
+    co->set_shape((trimA ? IR_TRIM : 0) | (minphaseA ? IR_MINPHASE : 0));
     co->set_samplerate(s_rate);
-    co->set_buffersize(bufsize);
+    co->set_buffersize(size);
+    co->set_channels(channelsIn, channelsOut);
+    setFallback(*file);
+    co->set_fallback(fallback.load(std::memory_order_relaxed),
+                     shorten.load(std::memory_order_relaxed));
 
     if (*file != "None") {
-        co->configure(*file, 1.0, 0, 0, 0, 0, 0);
+        co->configure(*file, std::pow(10.0f, irGainA * 0.05f), toSamples(delayA),
+                      toSamples(offsetA), toSamples(lengthA), 0, 0);
         while (!co->checkstate());
         if(!co->start(rt_prio, rt_policy)) {
             *file = "None";
+            co->cleanup();
            // lv2_log_error(&logger,"impulse convolver update fail\n");
         }
     }
+    setIrInfo(*file != "None" ? co : nullptr);
+    // only the block size changed or a step back to a longer IR, warm up
+    // the new convolver before the crossfade. After missed deadlines the
+    // load is cut at once.
+    const std::string base = *file + "|" + std::to_string(irGainA) + "|" +
+        std::to_string(delayA) + "|" + std::to_string(offsetA) + "|" +
+        std::to_string(lengthA) + "|" + std::to_string(trimA) + "|" +
+        std::to_string(minphaseA) + "|";
+    const std::string key = base + std::to_string(shorten.load(std::memory_order_relaxed));
+    const uint32_t from = slotActive(slots.load(std::memory_order_acquire));
+    const bool replanned = *file != "None" && !adapting && from != NOSLOT &&
+                           conv[from].is_runnable() && (key == slotKey[from] ||
+                           (a == ADAPT_RECOVER && slotKey[from].compare(0, base.size(), base) == 0));
+    slotKey[slot] = key;
+    slotWarmup[slot].store(replanned ? co->get_ir_length() + toSamples(delayA) : 0,
+                           std::memory_order_release);
+    // planned for a unknown block size, it's done again when it's known
+    planSize.store(*file != "None" ? std::max(size, 1U) : 0, std::memory_order_release);
+    publishSlot(slot);
+    adapt.store(ADAPT_NONE, std::memory_order_release);
 }
 
 void Engine::do_work_mono() {
     // set ir files
     if (_cd.load(std::memory_order_acquire) == 1) {
-        setIRFile(&conv, &ir_file);
+        setIRFile(&ir_file);
     }
     // set flag that work is done ready
     _execute.store(false, std::memory_order_release);
@@ -195,35 +681,276 @@ void Engine::do_work_mono() {
     _notify_ui.store(true, std::memory_order_release);
 }
 
-inline void Engine::process(uint32_t n_samples, float* input0, float* output0) {
-    if(n_samples<1) return;
+// pick up a new prepared convolver when the last crossfade is done
+inline uint32_t Engine::pickupSlot() {
+    uint32_t s = slots.load(std::memory_order_acquire);
+    if (slotPending(s) != NOSLOT && slotFading(s) == NOSLOT) {
+        const uint32_t n = makeSlots(slotPending(s), slotActive(s), NOSLOT);
+        if (slots.compare_exchange_strong(s, n, std::memory_order_acq_rel)) {
+            s = n;
+            fade.reset(0.0f);
+            warmup = slotWarmup[slotActive(n)].load(std::memory_order_acquire);
+            if (!warmup) fade.set(1.0f);
+            // both convolvers run until the fade is done, and the new one start cold
+            settle = warmup + fadeLength + s_rate / 2;
+        }
+    }
+    return s;
+}
 
-    // basic bypass
-    if (!bypass) {
-        Sync.notify_all();
+// count the missed deadlines per second. Only a overload in BADSECONDS seconds
+// in a row let the engine react, unless there is nothing left to fall back to,
+// and recoverTime seconds without a miss take the last reaction back.
+// The misses after a swap are shown, but don't count here.
+inline void Engine::checkLoad(uint32_t tailMisses, uint64_t time, uint32_t n_samples) {
+    // the wait for a missed tail is in the time as well
+    const bool overrun = !tailMisses &&
+        time * s_rate > static_cast<uint64_t>(n_samples) * 1000000000ULL;
+    if (tailMisses || overrun)
+        misses.fetch_add(tailMisses + overrun, std::memory_order_relaxed);
+    if (settle) {
+        settle -= std::min(settle, n_samples);
+        recentMisses = recentOverruns = loadTime = 0;
         return;
     }
-    // do inplace processing on default
-    if(output0 != input0)
-        memcpy(output0, input0, n_samples*sizeof(float));
+    if (adapt.load(std::memory_order_relaxed) != ADAPT_NONE) return;
+    recentMisses += tailMisses;
+    recentOverruns += overrun;
+    loadTime += n_samples;
+    if (loadTime < s_rate) return;
+
+    const bool tail = recentMisses >= MISSLIMIT &&
+                      fallback.load(std::memory_order_relaxed) < ConvPlan::FALLBACK_MAX;
+    const bool load = recentOverruns >= MISSLIMIT &&
+                      shorten.load(std::memory_order_relaxed) < MAXSHORTEN;
+    badSeconds = tail || load ? badSeconds + 1 : 0;
+    cleanSeconds = recentMisses || recentOverruns ? 0 : cleanSeconds + 1;
+    uint32_t a = ADAPT_NONE;
+    if (badSeconds >= BADSECONDS)
+        a = tail ? ADAPT_TAIL : ADAPT_LOAD;
+    else if (cleanSeconds >= recoverTime.load(std::memory_order_relaxed) &&
+             (fallback.load(std::memory_order_relaxed) || shorten.load(std::memory_order_relaxed)))
+        a = ADAPT_RECOVER;
+    if (a != ADAPT_NONE) {
+        adapt.store(a, std::memory_order_release);
+        badSeconds = 0;
+        cleanSeconds = 0;
+    }
+    recentMisses = recentOverruns = loadTime = 0;
+}
+
+// retire the old convolver, the worker thread will clean it up
+inline uint32_t Engine::retireFading(uint32_t s) {
+    uint32_t n;
+    do {
+        n = makeSlots(slotActive(s), NOSLOT, slotPending(s));
+    } while (!slots.compare_exchange_weak(s, n, std::memory_order_acq_rel));
+    return n;
+}
+
+// the input gain is applied in one pass while the input is moved to the
+// output, the convolver work in place on it and the dry/wet mix is one
+// more pass. At full wet the dry signal isn't kept, without wet the
+// convolution is skipped. Return the tail blocks which missed the deadline.
+inline uint32_t Engine::processChunk(uint32_t n, float* const* input, float* const* output,
+                                     uint32_t chans, uint32_t s) {
+    ConvolverSelector *co = &conv[slotActive(s)];
+    ConvolverSelector *fo = slotFading(s) != NOSLOT ? &conv[slotFading(s)] : nullptr;
+
+    if (wetGain.at(0.0f)) {
+        for (uint32_t c = 0; c < chans; c++) {
+            if (output[c] != input[c])
+                memcpy(output[c], input[c], n * sizeof(float));
+        }
+        inGain.advance(n);
+        fade.advance(n);
+        return 0;
+    }
 
-    bufsize = n_samples;
-    float buf0[n_samples];
-    memcpy(buf0, input0, n_samples*sizeof(float));
+    // keep the inputs the outputs will overwrite, the input may be
+    // routed to both outputs
+    const bool wetOnly = wetGain.at(1.0f);
+    const float* dry[2];
+    for (uint32_t c = 0; c < chans; c++) {
+        const bool shared = input[c] == output[0] || (chans > 1 && input[c] == output[1]);
+        if (shared && (!wetOnly || input[c] != output[c])) {
+            memcpy(dryBuf[c], input[c], n * sizeof(float));
+            dry[c] = dryBuf[c];
+        } else {
+            dry[c] = input[c];
+        }
+    }
+    for (uint32_t c = 0; c < chans; c++) inGain.gain(output[c], dry[c], n);
+    inGain.advance(n);
+
+    uint32_t tailMisses = 0;
+    if (fo) {
+        // crossfade from the old convolver to the new one
+        for (uint32_t c = 0; c < chans; c++)
+            memcpy(fadeBuf[c], output[c], n * sizeof(float));
+        if (fo->is_runnable()) {
+            if (chans > 1) fo->compute_stereo(n, fadeBuf[0], fadeBuf[1], fadeBuf[0], fadeBuf[1]);
+            else fo->compute(n, fadeBuf[0], fadeBuf[0]);
+        }
+        tailMisses = fo->take_misses();
+    }
+    if (co->is_runnable()) {
+        if (chans > 1) co->compute_stereo(n, output[0], output[1], output[0], output[1]);
+        else co->compute(n, output[0], output[0]);
+    }
+    tailMisses += co->take_misses();
+    if (fo) {
+        for (uint32_t c = 0; c < chans; c++) fade.fade(output[c], fadeBuf[c], output[c], n);
+    }
+    fade.advance(n);
 
+    if (!wetOnly) {
+        for (uint32_t c = 0; c < chans; c++) wetGain.fade(output[c], dry[c], output[c], n);
+    }
+    wetGain.advance(n);
+    return tailMisses;
+}
+
+// return the tail blocks which missed the deadline, the time is checked in run()
+inline uint32_t Engine::convolve(uint32_t n_samples, float* const* input, float* const* output,
+                                 uint32_t chans) {
     MXCSR.set_();
 
-    // process conv
-    plugin1->compute(n_samples, output0, output0);
-    if (!_execute.load(std::memory_order_acquire) && conv.is_runnable())
-        conv.compute(n_samples, output0, output0);
-    plugin2->compute(n_samples, buf0, output0, output0);
-    
-   
-    // notify neural modeller that process cycle is done
-    Sync.notify_all();
+    uint32_t s = pickupSlot();
+    uint32_t tailMisses = 0;
+    inGain.set(std::pow(10.0f, plugin1->gain * 0.05f) * normGain(&conv[slotActive(s)]));
+    wetGain.set(std::min(std::max(plugin2->dry_wet, 0.0f), 100.0f) / 100.0f);
+
+    for (uint32_t done = 0; done < n_samples; ) {
+        const uint32_t n = std::min(n_samples - done, chunkSize);
+        float* in[2];
+        float* out[2];
+        for (uint32_t c = 0; c < chans; c++) {
+            in[c] = input[c] + done;
+            out[c] = output[c] + done;
+        }
+        tailMisses += processChunk(n, in, out, chans, s);
+        if (slotFading(s) != NOSLOT) {
+            if (warmup) {
+                warmup -= std::min(warmup, n);
+                if (!warmup) fade.set(1.0f);
+            } else if (!fade.left) {
+                s = retireFading(s);
+            }
+        }
+        done += n;
+    }
+
     MXCSR.reset_();
+    return tailMisses;
+}
+
+// with a latency the output is one FIFO block late, the dry signal and
+// the bypass as well, so the latency reported to the host is kept.
+// A new latency mode start with empty FIFOs. The whole FIFO block is
+// convolved in one piece in the host call which fill it, so the plan
+// for the latency is used, but that call take longer then the others.
+// The load is checked against the time of the FIFO block, the host
+// calls it's collected in are summed up for it.
+inline void Engine::run(uint32_t n_samples, float* const* input, float* const* output,
+                        uint32_t chans) {
+    const uint64_t start = ThreadPool::now();
+    pickupScratch();
+    const uint32_t lat = get_latency();
+    if (lat != latency.load(std::memory_order_relaxed)) {
+        for (uint32_t c = 0; c < 2; c++) {
+            memset(fifoIn[c], 0, MAXLATENCY * sizeof(float));
+            memset(fifoOut[c], 0, MAXLATENCY * sizeof(float));
+        }
+        fifoPos = 0;
+        fifoTime = 0;
+        fifoSamples = 0;
+        fifoMisses = 0;
+        latency.store(lat, std::memory_order_release);
+    }
+
+    if (!lat) {
+        if (bypass) {
+            // the partitions are planned again for a larger block
+            if (n_samples > bufsize.load(std::memory_order_relaxed))
+                bufsize.store(n_samples, std::memory_order_release);
+            const uint32_t tailMisses = convolve(n_samples, input, output, chans);
+            checkLoad(tailMisses, ThreadPool::now() - start, n_samples);
+        } else {
+            for (uint32_t c = 0; c < chans; c++) {
+                if (output[c] != input[c])
+                    memcpy(output[c], input[c], n_samples * sizeof(float));
+            }
+        }
+        return;
+    }
+
+    bool filled = false;
+    for (uint32_t done = 0; done < n_samples; ) {
+        const uint32_t n = std::min(n_samples - done, lat - fifoPos);
+        // all inputs first, the outputs may overwrite them
+        for (uint32_t c = 0; c < chans; c++)
+            memcpy(fifoIn[c] + fifoPos, input[c] + done, n * sizeof(float));
+        for (uint32_t c = 0; c < chans; c++)
+            memcpy(output[c] + done, fifoOut[c] + fifoPos, n * sizeof(float));
+        fifoPos += n;
+        done += n;
+        if (fifoPos == lat) {
+            fifoPos = 0;
+            filled = true;
+            if (bypass) {
+                fifoMisses += convolve(lat, fifoIn, fifoOut, chans);
+            } else {
+                for (uint32_t c = 0; c < chans; c++)
+                    memcpy(fifoOut[c], fifoIn[c], lat * sizeof(float));
+            }
+        }
+    }
+    if (!bypass) {
+        fifoTime = fifoSamples = fifoMisses = 0;
+        return;
+    }
+    fifoTime += ThreadPool::now() - start;
+    fifoSamples += n_samples;
+    if (filled) {
+        checkLoad(fifoMisses, fifoTime, fifoSamples);
+        fifoTime = fifoSamples = fifoMisses = 0;
+    }
+}
+
+inline void Engine::process(uint32_t n_samples, float* input0, float* output0) {
+    if(n_samples<1) return;
+
+    // pass the input through without buffers, the bypass is done in run()
+    if (!chunkSize) {
+        if(output0 != input0)
+            memcpy(output0, input0, n_samples*sizeof(float));
+        return;
+    }
+
+    float* input[1] = {input0};
+    float* output[1] = {output0};
+    run(n_samples, input, output, 1);
+}
+
+// stereo processing, with a single input channel input1 is ignored
+inline void Engine::process(uint32_t n_samples, float* input0, float* input1,
+                            float* output0, float* output1) {
+    if(n_samples<1) return;
+    if (channelsIn < 2) input1 = input0;
+
+    // pass the input through without buffers, the bypass is done in run()
+    if (!chunkSize) {
+        if(output0 != input0)
+            memcpy(output0, input0, n_samples*sizeof(float));
+        if(output1 != input1)
+            memcpy(output1, input1, n_samples*sizeof(float));
+        return;
+    }
 
+    float* input[2] = {input0, input1};
+    float* output[2] = {output0, output1};
+    run(n_samples, input, output, 2);
 }
 
 }; // end namespace neuralrack
@@ -0,0 +1,362 @@
+/*
+ * fftbackend.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "fftbackend.h"
+#include "ircache.h"
+#include "AudioFFT.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+
+#ifdef HAVE_FFTW3
+#include <fftw3.h>
+#endif
+#ifdef HAVE_PFFFT
+#include "pffft.h"
+#endif
+
+
+namespace fft {
+
+namespace {
+
+enum {
+    AUDIOFFT,
+    FFTW3,
+    PFFFT
+};
+
+// the FFT build into FFTConvolver's AudioFFT
+static const char* audiofftName()
+{
+#if defined(AUDIOFFT_FFTW3)
+    return "audiofft-fftw3";
+#elif defined(AUDIOFFT_APPLE_ACCELERATE)
+    return "accelerate";
+#else
+    return "ooura";
+#endif
+}
+
+static const char* name(int backend)
+{
+    switch (backend) {
+        case FFTW3: return "fftw3";
+        case PFFFT: return "pffft";
+        default: return audiofftName();
+    }
+}
+
+static std::vector<int> available()
+{
+    std::vector<int> list;
+#ifdef HAVE_PFFFT
+    list.push_back(PFFFT);
+#endif
+#ifdef HAVE_FFTW3
+    list.push_back(FFTW3);
+#endif
+    list.push_back(AUDIOFFT);
+    return list;
+}
+
+// the plans made so far, the backend is fixed with the first one
+struct Registry {
+    std::mutex mutex;
+    std::map<uint32_t, std::shared_ptr<const Plan> > plans;
+    int backend;
+    bool used;
+    bool wisdom;
+
+    Registry() : backend(-1), used(false), wisdom(false) {}
+};
+
+static Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+// the default is the first build in one, or the one named by IMPULSELOADER_FFT
+static int current(Registry& r)
+{
+    if (r.backend >= 0) return r.backend;
+    const std::vector<int> list = available();
+    r.backend = list[0];
+    const char* env = getenv("IMPULSELOADER_FFT");
+    if (env && *env) {
+        bool found = false;
+        for (int b : list) {
+            if (strcmp(env, name(b)) == 0) {
+                r.backend = b;
+                found = true;
+            }
+        }
+        if (!found) fprintf(stderr, "FFT backend %s isn't available, use %s\n", env, name(r.backend));
+    }
+    return r.backend;
+}
+
+// the split complex buffers start 64 byte aligned
+static inline uint32_t padded(uint32_t n)
+{
+    return (n + 15) & ~15u;
+}
+
+#ifdef HAVE_FFTW3
+/****************************************************************
+ ** FftwPlan - FFTW plans for the split complex format, the caller
+ *             buffers are copied to the aligned work memory, so the
+ *             new-array execute functions could use the shared plan
+ */
+
+class FftwPlan : public Plan
+{
+public:
+    uint32_t workSize() const override { return _size + 2 * padded(_complexSize);}
+
+    void forward(const float* data, float* re, float* im, float* work) const override {
+        float* wre = work + _size;
+        float* wim = wre + padded(_complexSize);
+        memcpy(work, data, _size * sizeof(float));
+        fftwf_execute_split_dft_r2c(_forward, work, wre, wim);
+        memcpy(re, wre, _complexSize * sizeof(float));
+        memcpy(im, wim, _complexSize * sizeof(float));
+    }
+
+    void inverse(float* data, const float* re, const float* im, float* work) const override {
+        float* wre = work + _size;
+        float* wim = wre + padded(_complexSize);
+        memcpy(wre, re, _complexSize * sizeof(float));
+        memcpy(wim, im, _complexSize * sizeof(float));
+        fftwf_execute_split_dft_c2r(_inverse, wre, wim, work);
+        const float scale = 1.0f / _size;
+        for (uint32_t i = 0; i < _size; i++) data[i] = work[i] * scale;
+    }
+
+    bool init(uint32_t size) {
+        _size = size;
+        _complexSize = size / 2 + 1;
+        float* mem = static_cast<float*>(fftwf_malloc(workSize() * sizeof(float)));
+        if (!mem) return false;
+        float* wre = mem + _size;
+        float* wim = wre + padded(_complexSize);
+        fftwf_iodim dim;
+        dim.n = size;
+        dim.is = 1;
+        dim.os = 1;
+        _forward = fftwf_plan_guru_split_dft_r2c(1, &dim, 0, nullptr, mem, wre, wim, FFTW_MEASURE);
+        _inverse = fftwf_plan_guru_split_dft_c2r(1, &dim, 0, nullptr, wre, wim, mem, FFTW_MEASURE);
+        fftwf_free(mem);
+        return _forward && _inverse;
+    }
+
+    FftwPlan() : _size(0), _complexSize(0), _forward(nullptr), _inverse(nullptr) {}
+    ~FftwPlan() {
+        if (_forward) fftwf_destroy_plan(_forward);
+        if (_inverse) fftwf_destroy_plan(_inverse);
+    }
+
+private:
+    uint32_t _size;
+    uint32_t _complexSize;
+    fftwf_plan _forward;
+    fftwf_plan _inverse;
+};
+
+static std::string wisdomFile()
+{
+    const std::string dir = IrCache::cacheDir();
+    return dir.empty() ? dir : dir + "/fftw3f.wisdom";
+}
+
+// FFTConvolver may plan in other threads as well
+static void loadWisdom(Registry& r)
+{
+    if (r.wisdom) return;
+    r.wisdom = true;
+    fftwf_make_planner_thread_safe();
+    const std::string path = wisdomFile();
+    if (!path.empty() && IrCache::instance().diskCache())
+        fftwf_import_wisdom_from_filename(path.c_str());
+}
+
+static void saveWisdom()
+{
+    const std::string path = wisdomFile();
+    if (path.empty() || !IrCache::instance().diskCache() || !IrCache::makeCacheDir()) return;
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+    if (fftwf_export_wisdom_to_filename(tmp.c_str()) && rename(tmp.c_str(), path.c_str()) == 0) return;
+    unlink(tmp.c_str());
+}
+#endif
+
+#ifdef HAVE_PFFFT
+/****************************************************************
+ ** PffftPlan - the pffft setup hold the twiddle tables, the ordered
+ *              real output (dc, nyquist, re/im pairs) is split here
+ */
+
+class PffftPlan : public Plan
+{
+public:
+    uint32_t workSize() const override { return 3 * _size;}
+
+    void forward(const float* data, float* re, float* im, float* work) const override {
+        float* out = work + _size;
+        memcpy(work, data, _size * sizeof(float));
+        pffft_transform_ordered(_setup, work, out, work + 2 * _size, PFFFT_FORWARD);
+        const uint32_t half = _size / 2;
+        re[0] = out[0];
+        im[0] = 0.0f;
+        re[half] = out[1];
+        im[half] = 0.0f;
+        for (uint32_t k = 1; k < half; k++) {
+            re[k] = out[2 * k];
+            im[k] = out[2 * k + 1];
+        }
+    }
+
+    void inverse(float* data, const float* re, const float* im, float* work) const override {
+        float* in = work + _size;
+        const uint32_t half = _size / 2;
+        in[0] = re[0];
+        in[1] = re[half];
+        for (uint32_t k = 1; k < half; k++) {
+            in[2 * k] = re[k];
+            in[2 * k + 1] = im[k];
+        }
+        pffft_transform_ordered(_setup, in, work, work + 2 * _size, PFFFT_BACKWARD);
+        const float scale = 1.0f / _size;
+        for (uint32_t i = 0; i < _size; i++) data[i] = work[i] * scale;
+    }
+
+    bool init(uint32_t size) {
+        _size = size;
+        _setup = pffft_new_setup(size, PFFFT_REAL);
+        return _setup != nullptr;
+    }
+
+    PffftPlan() : _size(0), _setup(nullptr) {}
+    ~PffftPlan() { if (_setup) pffft_destroy_setup(_setup);}
+
+private:
+    uint32_t _size;
+    PFFFT_Setup* _setup;
+};
+#endif
+
+// the shared plan for the size, nullptr for the audiofft backend
+static std::shared_ptr<const Plan> makePlan(uint32_t size)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const int backend = current(r);
+    r.used = true;
+    if (backend == AUDIOFFT) return nullptr;
+    auto it = r.plans.find(size);
+    if (it != r.plans.end()) return it->second;
+
+    std::shared_ptr<const Plan> plan;
+#ifdef HAVE_FFTW3
+    if (backend == FFTW3) {
+        loadWisdom(r);
+        std::shared_ptr<FftwPlan> p = std::make_shared<FftwPlan>();
+        if (p->init(size)) {
+            plan = p;
+            saveWisdom();
+        }
+    }
+#endif
+#ifdef HAVE_PFFFT
+    // pffft need a multiple of 32 for a real transform
+    if (backend == PFFFT && size >= 32) {
+        std::shared_ptr<PffftPlan> p = std::make_shared<PffftPlan>();
+        if (p->init(size)) plan = p;
+    }
+#endif
+    if (!plan) return nullptr;
+    r.plans[size] = plan;
+    return plan;
+}
+
+} // namespace
+
+std::vector<std::string> backends()
+{
+    std::vector<std::string> list;
+    for (int b : available()) list.push_back(name(b));
+    return list;
+}
+
+bool setBackend(const std::string& backend)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (int b : available()) {
+        if (backend != name(b)) continue;
+        if (r.used && r.backend != b) return false;
+        r.backend = b;
+        return true;
+    }
+    return false;
+}
+
+const char* backendName()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return name(current(r));
+}
+
+/****************************************************************
+ ** Transform
+ */
+
+Transform::Transform() : _size(0), _work(nullptr) {}
+
+Transform::~Transform() {}
+
+bool Transform::init(uint32_t size)
+{
+    _plan.reset();
+    _local.reset();
+    _memory.clear();
+    _work = nullptr;
+    _size = 0;
+    if (size == 0 || (size & (size - 1)) != 0) return false;
+    _size = size;
+    _plan = makePlan(size);
+    if (!_plan) {
+        _local.reset(new audiofft::AudioFFT());
+        _local->init(size);
+        return true;
+    }
+    _memory.resize(_plan->workSize() + 16, 0.0f);
+    const uintptr_t p = reinterpret_cast<uintptr_t>(_memory.data());
+    _work = _memory.data() + ((64 - (p & 63)) & 63) / sizeof(float);
+    return true;
+}
+
+void Transform::fft(const float* data, float* re, float* im)
+{
+    if (_plan) _plan->forward(data, re, im, _work);
+    else _local->fft(data, re, im);
+}
+
+void Transform::ifft(float* data, const float* re, const float* im)
+{
+    if (_plan) _plan->inverse(data, re, im, _work);
+    else _local->ifft(data, re, im);
+}
+
+} // namespace fft
@@ -0,0 +1,89 @@
+/*
+ * fftbackend.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef FFTBACKEND_H_
+#define FFTBACKEND_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace audiofft {
+class AudioFFT;
+}
+
+/****************************************************************
+ ** fft - the real FFT used by the engine, with several backends:
+ *        audiofft (the one build into FFTConvolver, Ooura by default),
+ *        fftw3 (make FFTW=1) and pffft (make PFFFT=1).
+ *        The backend is selected at run time from the build in ones,
+ *        by IMPULSELOADER_FFT or setBackend(), before the first transform.
+ *        Plans and twiddle tables are made once per size and shared by
+ *        all transforms in the process, the FFTW wisdom is kept in the
+ *        cache directory. The spectra are split complex, size / 2 + 1 bins,
+ *        the inverse is scaled by 1 / size, for all backends.
+ */
+
+namespace fft {
+
+// the backends build in, the first one is the default
+std::vector<std::string> backends();
+// false when the backend isn't build in or transforms exist already
+bool setBackend(const std::string& name);
+const char* backendName();
+
+// the shared, read only part of a transform of one size
+class Plan
+{
+public:
+    // floats of work memory needed per transform, 64 byte aligned
+    virtual uint32_t workSize() const = 0;
+    virtual void forward(const float* data, float* re, float* im, float* work) const = 0;
+    virtual void inverse(float* data, const float* re, const float* im, float* work) const = 0;
+
+    Plan() {}
+    virtual ~Plan() {}
+};
+
+/****************************************************************
+ ** Transform - a real FFT of a power of 2 size, the plan is shared,
+ *              the work memory is owned, so each thread need it's own.
+ *              A drop-in for audiofft::AudioFFT.
+ */
+
+class Transform
+{
+public:
+    bool init(uint32_t size);
+    void fft(const float* data, float* re, float* im);
+    void ifft(float* data, const float* re, const float* im);
+
+    inline uint32_t size() const { return _size;}
+    static inline uint32_t ComplexSize(uint32_t size) { return size / 2 + 1;}
+
+    Transform();
+    ~Transform();
+    Transform(const Transform&) = delete;
+    Transform& operator=(const Transform&) = delete;
+
+private:
+    uint32_t _size;
+    std::shared_ptr<const Plan> _plan;
+    // the audiofft backend can't share it's tables
+    std::unique_ptr<audiofft::AudioFFT> _local;
+    std::vector<float> _memory;
+    float* _work;
+};
+
+} // namespace fft
+
+#endif  // FFTBACKEND_H_
@@ -9,6 +9,11 @@
 
 #include "fftconvolver.h"
 #include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
 
 
 /****************************************************************
@@ -32,13 +37,104 @@ void Audiofile::reset(void) {
     _rate = 0;
     _chan = 0;
     _size = 0;
+    _map = nullptr;
+    _mapSize = 0;
+    _data = nullptr;
+    _frameBytes = 0;
+    _pos = 0;
+}
+
+static inline uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// the fast path, parse the RIFF/WAVE header from the mapped file,
+// false for anything we don't handle here, libsndfile take it then
+bool Audiofile::open_mapped(const std::string& name) {
+#if !defined(_WIN32) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 44) {
+        ::close(fd);
+        return false;
+    }
+    const size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    const uint8_t* p = static_cast<const uint8_t*>(map);
+    if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+        munmap(map, size);
+        return false;
+    }
+
+    uint32_t tag = 0, chan = 0, rate = 0, align = 0, bits = 0;
+    const uint8_t* data = nullptr;
+    size_t dataLen = 0;
+    bool haveFmt = false;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const uint8_t* body = p + pos + 8;
+        const uint32_t len = read32(p + pos + 4);
+        if (memcmp(p + pos, "fmt ", 4) == 0 && len >= 16 && len <= size - pos - 8) {
+            tag = read16(body);
+            chan = read16(body + 2);
+            rate = read32(body + 4);
+            align = read16(body + 12);
+            bits = read16(body + 14);
+            // WAVE_FORMAT_EXTENSIBLE, the format is the start of the sub format GUID
+            if (tag == 0xFFFE && len >= 40) tag = read16(body + 24);
+            haveFmt = true;
+        } else if (memcmp(p + pos, "data", 4) == 0) {
+            // a truncated file is read as far as it goes
+            data = body;
+            dataLen = std::min(static_cast<size_t>(len), size - pos - 8);
+            break;
+        }
+        pos += 8 + static_cast<size_t>(len) + (len & 1);
+    }
+
+    int form = FORM_OTHER;
+    if (tag == 1 && bits == 16) form = FORM_16BIT;
+    else if (tag == 1 && bits == 24) form = FORM_24BIT;
+    else if (tag == 1 && bits == 32) form = FORM_32BIT;
+    else if (tag == 3 && bits == 32) form = FORM_FLOAT;
+    if (!haveFmt || !data || form == FORM_OTHER || chan == 0 || rate == 0 ||
+            align != chan * (bits / 8)) {
+        munmap(map, size);
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    _map = map;
+    _mapSize = size;
+    _data = data;
+    _frameBytes = align;
+    _pos = 0;
+    _type = TYPE_WAV;
+    _form = form;
+    _rate = rate;
+    _chan = chan;
+    _size = dataLen / align;
+    return true;
+#else
+    return false;
+#endif
 }
 
 
 int Audiofile::open_read(std::string name) {
     SF_INFO I;
 
-    reset();
+    close();
+
+    if (open_mapped(name)) return 0;
 
     if ((_sndfile = sf_open(name.c_str(), SFM_READ, &I)) == 0) return ERR_OPEN;
 
@@ -86,12 +182,20 @@ int Audiofile::open_read(std::string name) {
 
 int Audiofile::close(void) {
     if (_sndfile) sf_close(_sndfile);
+#ifndef _WIN32
+    if (_map) munmap(_map, _mapSize);
+#endif
     reset();
     return 0;
 }
 
 
 int Audiofile::seek(uint32_t posit) {
+    if (_map) {
+        if (posit > _size) return ERR_SEEK;
+        _pos = posit;
+        return 0;
+    }
     if (!_sndfile) return ERR_MODE;
     if (sf_seek(_sndfile, posit, SEEK_SET) != posit) return ERR_SEEK;
     return 0;
@@ -99,6 +203,20 @@ int Audiofile::seek(uint32_t posit) {
 
 
 int Audiofile::read(float *data, uint32_t frames) {
+    if (_map) {
+        frames = std::min(frames, _size - _pos);
+        const uint8_t* src = _data + static_cast<size_t>(_pos) * _frameBytes;
+        const uint32_t n = frames * _chan;
+        switch (_form) {
+            case FORM_16BIT: simd::convertS16(data, src, n); break;
+            case FORM_24BIT: simd::convertS24(data, src, n); break;
+            case FORM_32BIT: simd::convertS32(data, src, n); break;
+            default:         memcpy(data, src, n * sizeof(float)); break;
+        }
+        _pos += frames;
+        return frames;
+    }
+    if (!_sndfile) return ERR_MODE;
     return sf_readf_float(_sndfile, data, frames);
 }
 
@@ -107,295 +225,502 @@ int Audiofile::read(float *data, uint32_t frames) {
  ** ConvolverSelector
  */
 
+// the part of the IR to use, a length of 0 use it up to the end,
+// at least a single sample is left
+static inline uint32_t irRange(uint32_t irLen, unsigned int* offset, unsigned int length) {
+    *offset = std::min(*offset, irLen - 1);
+    const uint32_t left = irLen - *offset;
+    return length ? std::min(length, left) : left;
+}
+
 bool ConvolverSelector::configure(std::string fname, float gain, unsigned int delay,
                     unsigned int offset, unsigned int length, unsigned int size, unsigned int bufsize) {
-    Audiofile audio;
-    if (audio.open_read(fname)) {
-        fprintf(stderr, "Unable to open %s\n", fname.c_str() );
-        return false;
-    }
-    int asize = audio.size();
-    //fprintf(stderr, "%i Run %s\n",asize, asize>16384 ? "DoubleThreadConvolver" : "SingelThreadConvolver");
-    audio.close();
-    int maxSize = 16384;
-    #ifdef __MOD_DEVICES__
-    maxSize = 4069;
-    #endif
-    if (asize > maxSize) conv = &dconv;
+    // load the IR once, the selected convolver pick it up from the cache
+    const uint32_t inputs = channelsOut > 1 ? channelsIn : 1;
+    std::shared_ptr<const IrData> ir = IrReader::loadCached(fname, samplerate, shape,
+                                                            inputs, channelsOut);
+    irLength = 0;
+    sourceLength = 0;
+    normGain[0] = normGain[1] = 1.0f;
+    if (!ir) return false;
+    normGain[0] = IrReader::normalisation(*ir, 0);
+    normGain[1] = IrReader::normalisation(*ir, 1);
+    irLength = irRange(ir->length, &offset, length);
+    sourceLength = ir->sourceLength;
+    // the process thread run out of time, use the first part of the IR only
+    if (shorten) irLength = std::max(irLength >> std::min(shorten, 8U), 1U);
+
+    // the convolver and the partition sizes with the lowest load on this box,
+    // the stereo modes and the pre-delay need the multi stage convolver
+    const uint32_t chan = ir->channels.size();
+    const uint32_t paths = channelsOut < 2 ? 1 : (channelsIn > 1 && chan >= 4) ? 4 : 2;
+    const ConvPlan plan = Planner::instance().plan(irLength + delay, delay, buffersize,
+                            samplerate, inputs, channelsOut, paths, channelsOut > 1 || delay,
+                            fallback);
+    if (plan.engine == ConvPlan::MULTI) conv = &msconv;
+    else if (plan.engine == ConvPlan::DOUBLE) conv = &dconv;
+    else if (plan.engine == ConvPlan::DIRECT) conv = &fconv;
     else conv = &sconv;
+    conv->set_plan(plan);
 
-    return conv->configure(fname, gain, delay, offset, length, size,bufsize);}
+    return conv->configure(fname, gain, delay, offset, irLength, size,bufsize);}
 
 
 /****************************************************************
  ** DoubleThreadConvolver
  */
 
-void DoubleThreadConvolver::startBackgroundProcessing()
+void DoubleThreadConvolver::backgroundProcessing()
 {
-    if (pro.getProcess()) {
-        pro.runProcess();
-    } else {
-        doBackgroundProcessing();
+    if (resync) {
+        bgConv.clear();
+        resync = false;
     }
+    bgConv.process(jobIn, jobOut, plan.tail);
 }
 
-
-void DoubleThreadConvolver::waitForBackgroundProcessing()
+// a job which missed the deadline still use the job buffers, so the
+// background tail stay silent for the next block and the miss is counted,
+// the head run on. A late job isn't waited for again, it's only checked,
+// it's result is dropped and the tail start over with a empty history.
+void DoubleThreadConvolver::swapTail()
 {
-    pro.processWait();
+    const bool done = late ? pro.getProcess() && pro.processWait() : pro.processWait();
+    if (!done) {
+        misses++;
+        late = true;
+        memset(outBuf, 0, plan.tail * sizeof(float));
+        return;
+    }
+    if (late) {
+        memset(jobOut, 0, plan.tail * sizeof(float));
+        late = false;
+        resync = true;
+    }
+    std::swap(outBuf, jobOut);
+    std::swap(jobIn, inBuf);
+    pro.runProcess(ThreadPool::now() + tailTime);
 }
 
-bool DoubleThreadConvolver::get_buffer(std::string fname, float **buffer, uint32_t *rate, int *asize)
+// the pre-delay isn't supported here, the selector use the multi stage convolver for it
+bool DoubleThreadConvolver::configure(std::string fname, float gain_, unsigned int delay, unsigned int offset,
+            unsigned int length, unsigned int size, unsigned int bufsize)
 {
-    Audiofile audio;
-    if (audio.open_read(fname)) {
-        fprintf(stderr, "Unable to open %s\n", fname.c_str() );
-        *buffer = 0;
-        return false;
-    }
-    *rate = audio.rate();
-    *asize = audio.size();
-    const int limit = 2000000; // arbitrary size limit
-    if (*asize > limit) {
-        fprintf(stderr, "too many samples (%i), truncated to %i\n"
-                           , audio.size(), limit);
-        *asize = limit;
-    }
-    if (*asize * audio.chan() == 0) {
-        fprintf(stderr, "No samples found\n");
-        *buffer = 0;
-        audio.close();
-        return false;
-    }
-    float* cbuffer = new float[*asize * audio.chan()];
-    if (audio.read(cbuffer, *asize) != static_cast<int>(*asize)) {
-        delete[] cbuffer;
-        fprintf(stderr, "Error reading file\n");
-        *buffer = 0;
-        audio.close();
-        return false;
-    }
-    if (audio.chan() > 1) {
-        //fprintf(stderr,"only taking first channel of %i channels in impulse response\n", audio.chan());
-        float *abuffer = new float[*asize];
-        for (int i = 0; i < *asize; i++) {
-            abuffer[i] = cbuffer[i * audio.chan()];
-        }
-        delete[] cbuffer;
-        cbuffer = NULL;
-        cbuffer = abuffer;
+    filename = fname;
+    misses = 0;
+    gain = gain_;
+    pro.stop();
+    bgConv.reset();
+    arena.rewind();
+    bgTail = false;
+    bgFill = 0;
+    late = false;
+    resync = false;
+    // reuse a prepared IR from the cache, when there
+    std::shared_ptr<const IrData> ir = IrReader::loadCached(fname, samplerate, shape, 1, 1);
+    if (!ir) return false;
+    const uint32_t len = irRange(ir->length, &offset, length);
+
+    pro.setTimeOut(std::max(100,static_cast<int>((buffersize/(samplerate*0.000001))*0.1)));
+    tailTime = static_cast<uint64_t>(plan.tail) * 1000000000ULL / std::max(samplerate, 1U);
+
+    // the rest of the IR after the first tail block run in the background
+    const uint32_t split = 2 * plan.tail;
+    if (len > split) {
+        std::shared_ptr<const IrPartitions> part =
+            IrCache::instance().loadPartitions(*ir, 0, plan.tail, offset + split, len - split);
+        if (!part || !bgConv.init(part, &arena)) return false;
+        inBuf = arena.alloc(plan.tail);
+        outBuf = arena.alloc(plan.tail);
+        jobIn = arena.alloc(plan.tail);
+        jobOut = arena.alloc(plan.tail);
+        if (!inBuf || !outBuf || !jobIn || !jobOut) return false;
+        bgTail = true;
     }
-    *buffer = cbuffer;
-    audio.close();
-    if (*rate != samplerate) {
-        *buffer = resamp.process(*rate, *asize, *buffer, samplerate, asize);
-        if (!*buffer) {
-            printf("no buffer\n");
-            return false;
-        }
-        //fprintf(stderr, "FFTConvolver: resampled from %i to %i\n", *rate, samplerate);
+
+    // the head and tail sizes come from the planner
+    if (init(plan.head, plan.tail, ir->channels[0].data() + offset, std::min(len, split))) {
+        ready = true;
+        return true;
     }
-    return true;
+    return false;
 }
 
-void DoubleThreadConvolver::normalize(float* buffer, int asize) {
-    // normalize
-    float gain = 0.0;
-    float peak = 0.0;
-    // get normalization peak
-    for (int i = 0; i < asize; i++) {
-        peak = std::max(peak, std::abs( buffer[i])) ;
-    }
-    // apply normalize factor and get gain factor
-    if (peak != 0.0) {
-        peak = 0.8 / peak;
-        for (int i = 0; i < asize; i++) {
-           buffer[i] *= peak;
-
-           double v = buffer[i] ;
-           gain += v*v;
-        }
-    }
-    //if (!norm) return;
-    // apply gain square root factor when needed
-    if (gain != 0.0) {
-        if (!norm) gain = 1.5 / gain;
-        else gain = 1.0 / gain;
-
-        for (int i = 0; i < asize; i++) {
-            buffer[i] *= gain;
+inline std::string DoubleThreadConvolver::getIrFile() {
+    return filename;
+}
+
+// the input is kept for the background tail before the base class
+// may overwrite it, the tail output is added to the head
+void DoubleThreadConvolver::compute(int32_t count, float* input, float* output)
+{
+    if (!ready) return;
+    int32_t done = 0;
+    while (done < count) {
+        const int32_t n = bgTail ? std::min<int32_t>(count - done, plan.tail - bgFill) : count - done;
+        if (bgTail) memcpy(inBuf + bgFill, input + done, n * sizeof(float));
+        process(input + done, output + done, n);
+        if (bgTail) {
+            const float* tail = outBuf + bgFill;
+            float* dst = output + done;
+            for (int32_t i = 0; i < n; i++) dst[i] += tail[i];
+            bgFill += n;
+            if (bgFill == plan.tail) {
+                bgFill = 0;
+                swapTail();
+            }
         }
+        done += n;
     }
+    if (gain != 1.0f) simd::scale(output, output, gain, count);
 }
 
-void DoubleThreadConvolver::set_normalisation(uint32_t norm_) {
-    norm = norm_;
-}
+/****************************************************************
+ ** SingleThreadConvolver
+ */
 
-bool DoubleThreadConvolver::configure(std::string fname, float gain, unsigned int delay, unsigned int offset,
+// the pre-delay isn't supported here, the selector use the multi stage convolver for it
+bool SingleThreadConvolver::configure(std::string fname, float gain_, unsigned int delay, unsigned int offset,
             unsigned int length, unsigned int size, unsigned int bufsize)
 {
     filename = fname;
-    float* abuf = NULL;
-    uint32_t arate = 0;
-    int asize = 0;
-    if (!get_buffer(fname, &abuf, &arate, &asize)) {
-        return false;
+    gain = gain_;
+    // reuse a prepared IR from the cache, when there
+    std::shared_ptr<const IrData> ir = IrReader::loadCached(fname, samplerate, shape, 1, 1);
+    if (!ir) return false;
+    const uint32_t len = irRange(ir->length, &offset, length);
+    // the partition size from the planner, it weight the FFT over the unfilled
+    // part on each process call against the count of partitions
+    if (init(plan.head, ir->channels[0].data() + offset, len)) {
+        ready = true;
+        return true;
     }
-    normalize(abuf, asize);
+    return false;
+}
 
-    pro.setTimeOut(std::max(100,static_cast<int>((buffersize/(samplerate*0.000001))*0.1)));
+inline std::string SingleThreadConvolver::getIrFile() {
+    return filename;
+}
 
-    uint32_t _head = 1;
-    while (_head < buffersize) {
-        _head *= 2;
-    }
+void SingleThreadConvolver::compute(int32_t count, float* input, float* output)
+{
+    if (!ready) return;
+    process(input, output, count);
+    if (gain != 1.0f) simd::scale(output, output, gain, count);
+}
 
-    uint32_t _tail = _head > 8192 ? _head : 8192;
-    #ifdef __MOD_DEVICES__
-    _head = 128;
-    _tail = 2048;
-    #endif
-    //fprintf(stderr, "head %i tail %i irlen %i \n", _head, _tail, asize);
-    if (init(_head, _tail, abuf, asize)) {
+/****************************************************************
+ ** FirConvolver
+ */
+
+// the pre-delay isn't supported here, the selector use the multi stage convolver for it
+bool FirConvolver::configure(std::string fname, float gain_, unsigned int delay, unsigned int offset,
+            unsigned int length, unsigned int size, unsigned int bufsize)
+{
+    filename = fname;
+    gain = gain_;
+    // reuse a prepared IR from the cache, when there
+    std::shared_ptr<const IrData> ir = IrReader::loadCached(fname, samplerate, shape, 1, 1);
+    if (!ir) return false;
+    const uint32_t len = irRange(ir->length, &offset, length);
+    std::vector<FirPath> paths(1, {0, 0, ir->channels[0].data() + offset, len, 0});
+    fir.reset();
+    arena.rewind();
+    if (fir.init(paths, 1, 1, buffersize, &arena)) {
         ready = true;
-        delete[] abuf;
         return true;
     }
-    delete[] abuf;
     return false;
 }
 
-inline std::string DoubleThreadConvolver::getIrFile() {
+inline std::string FirConvolver::getIrFile() {
     return filename;
 }
 
-void DoubleThreadConvolver::compute(int32_t count, float* input, float* output)
+void FirConvolver::compute(int32_t count, float* input, float* output)
 {
-    if (ready) process(input, output, count);
+    if (!ready) return;
+    const float* in = input;
+    fir.process(&in, &output, count);
+    if (gain != 1.0f) simd::scale(output, output, gain, count);
 }
 
 /****************************************************************
- ** SingleThreadConvolver
+ ** MultiStageConvolver
  */
 
-bool SingleThreadConvolver::get_buffer(std::string fname, float **buffer, uint32_t *rate, int *asize)
+bool MultiStageConvolver::start(int32_t policy, int32_t priority) {
+    pro.setTimeOut(std::max(100,static_cast<int>((buffersize/(samplerate*0.000001))*0.1)));
+    return ready;
+}
+
+// map the IR channels to the paths from input to output:
+// mono:            in -> out, first channel
+// mono to stereo:  in -> left/right, channel 1/2
+// stereo:          left -> left, right -> right, channel 1/2
+// true stereo:     LL, LR, RL, RR, channel 1 - 4
+// a mono IR is used for all outputs
+void MultiStageConvolver::setRoutes(uint32_t irChannels)
 {
-    Audiofile audio;
-    if (audio.open_read(fname)) {
-        fprintf(stderr, "Unable to open %s\n", fname.c_str() );
-        *buffer = 0;
-        return false;
-    }
-    *rate = audio.rate();
-    *asize = audio.size();
-    const int limit = 2000000; // arbitrary size limit
-    if (*asize > limit) {
-        fprintf(stderr, "too many samples (%i), truncated to %i\n"
-                           , audio.size(), limit);
-        *asize = limit;
-    }
-    if (*asize * audio.chan() == 0) {
-        fprintf(stderr, "No samples found\n");
-        *buffer = 0;
-        audio.close();
-        return false;
-    }
-    float* cbuffer = new float[*asize * audio.chan()];
-    if (audio.read(cbuffer, *asize) != static_cast<int>(*asize)) {
-        delete[] cbuffer;
-        fprintf(stderr, "Error reading file\n");
-        *buffer = 0;
-        audio.close();
-        return false;
-    }
-    if (audio.chan() > 1) {
-        //fprintf(stderr,"only taking first channel of %i channels in impulse response\n", audio.chan());
-        float *abuffer = new float[*asize];
-        for (int i = 0; i < *asize; i++) {
-            abuffer[i] = cbuffer[i * audio.chan()];
-        }
-        delete[] cbuffer;
-        cbuffer = NULL;
-        cbuffer = abuffer;
-    }
-    *buffer = cbuffer;
-    audio.close();
-    if (*rate != samplerate) {
-        *buffer = resamp.process(*rate, *asize, *buffer, samplerate, asize);
-        if (!*buffer) {
-            printf("no buffer\n");
-            return false;
-        }
-        //fprintf(stderr, "FFTConvolver: resampled from %i to %i\n", *rate, samplerate);
+    routes.clear();
+    const uint32_t second = irChannels > 1 ? 1 : 0;
+    if (channelsOut == 1) {
+        routes.push_back({0, 0, 0});
+    } else if (channelsIn == 1) {
+        routes.push_back({0, 0, 0});
+        routes.push_back({0, 1, second});
+    } else if (irChannels >= 4) {
+        routes.push_back({0, 0, 0});
+        routes.push_back({0, 1, 1});
+        routes.push_back({1, 0, 2});
+        routes.push_back({1, 1, 3});
+    } else {
+        routes.push_back({0, 0, 0});
+        routes.push_back({1, 1, second});
     }
-    return true;
 }
 
-void SingleThreadConvolver::normalize(float* buffer, int asize) {
-    // normalize
-    float gain = 0.0;
-    float peak = 0.0;
-    // get normalization peak
-    for (int i = 0; i < asize; i++) {
-        peak = std::max(peak, std::abs( buffer[i])) ;
+// the partition plan, stage 0 use the head block size and process
+// zero latency, each following stage use a 4 times larger block size,
+// up to the largest one from the planner.
+// A stage with block size B start at IR offset B, so it's output
+// is ready when needed. The last stage, when the planner say so, run in
+// the background thread and start at IR offset 2 * B, as it's output
+// is one block late.
+// The plan is made for the pre-delay plus the used length of the IR.
+// Stages covered by the pre-delay are left out, the others skip the
+// leading zero partitions and only the rest of the delay is part of
+// the first partition left.
+// With a FIR head the FIR cover the first head block size samples
+// zero latency, and stage 0 start at IR offset B like the others.
+bool MultiStageConvolver::init(const IrData& ir, uint32_t delay,
+                               uint32_t offset, uint32_t length)
+{
+    const uint32_t irLen = delay + length;
+    std::vector<uint32_t> blocks;
+    std::vector<uint32_t> offsets;
+    bool background = false;
+    Planner::stages(plan, irLen, &blocks, &offsets, &background);
+    const size_t last = blocks.size() - 1;
+
+    setRoutes(ir.channels.size());
+    headStage = false;
+    directHead = false;
+    // the start of the IR as FIR, when the pre-delay don't cover it
+    const uint32_t firLen = std::min(plan.fir, irLen);
+    if (firLen > delay) {
+        std::vector<FirPath> paths;
+        for (const Route& r : routes)
+            paths.push_back({r.input, r.output, ir.channels[r.channel].data() + offset,
+                             firLen - delay, delay});
+        if (!firHead.init(paths, channelsIn, channelsOut, std::max(buffersize, plan.head), &arena))
+            return false;
+        directHead = true;
     }
-    // apply normalize factor and get gain factor
-    if (peak != 0.0) {
-        peak = 0.8/peak;
-        for (int i = 0; i < asize; i++) {
-           buffer[i] *= peak;
-
-           double v = buffer[i] ;
-           gain += v*v;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (offsets[i+1] <= delay) continue;
+        // the zero partitions in front of the IR, and the zeros left for the first one
+        const uint32_t zeros = delay > offsets[i] ? delay - offsets[i] : 0;
+        const uint32_t skip = zeros / blocks[i];
+        const uint32_t lead = zeros % blocks[i];
+        const uint32_t start = std::max(offsets[i], delay) - delay;
+        const uint32_t partLen = offsets[i+1] - delay - start;
+        // one set of partitions per IR channel, shared by the paths using it
+        // and by all instances in the process using the same IR with the same plan
+        std::vector<std::shared_ptr<const IrPartitions> > parts;
+        for (uint32_t c = 0; c < ir.channels.size(); c++) {
+            std::shared_ptr<const IrPartitions> part =
+                IrCache::instance().loadPartitions(ir, c, blocks[i], offset + start, partLen, lead);
+            if (!part) return false;
+            parts.push_back(part);
         }
-    }
-    //if (!norm) return;
-    // apply gain square root factor when needed
-    if (gain != 0.0) {
-        if (!norm) gain = 1.5 / gain;
-        else gain = 1.0 / gain;
-
-        for (int i = 0; i < asize; i++) {
-            buffer[i] *= gain;
+        std::vector<ConvolutionPath> paths;
+        for (const Route& r : routes) paths.push_back({r.input, r.output, parts[r.channel]});
+        std::unique_ptr<Stage> st(new Stage());
+        if (!st->conv.init(paths, channelsIn, channelsOut, &arena, skip)) return false;
+        st->blockSize = blocks[i];
+        st->fill = 0;
+        st->background = (background && i == last);
+        st->late = false;
+        st->resync = false;
+        if (i == 0 && !plan.fir) headStage = true;
+        for (uint32_t c = 0; c < MAXCHANNELS; c++) {
+            const bool in = c < channelsIn;
+            const bool out = c < channelsOut;
+            const bool job = st->background;
+            st->inBuf[c] = in ? arena.alloc(blocks[i]) : nullptr;
+            st->outBuf[c] = out ? arena.alloc(blocks[i]) : nullptr;
+            st->jobIn[c] = in && job ? arena.alloc(blocks[i]) : nullptr;
+            st->jobOut[c] = out && job ? arena.alloc(blocks[i]) : nullptr;
+            if ((in && (!st->inBuf[c] || (job && !st->jobIn[c]))) ||
+                (out && (!st->outBuf[c] || (job && !st->jobOut[c])))) return false;
         }
+        if (st->background) bgStage = st.get();
+        stages.push_back(std::move(st));
     }
+    scratchSize = std::max(buffersize, plan.head);
+    for (uint32_t c = 0; c < channelsIn; c++) {
+        scratch[c] = arena.alloc(scratchSize);
+        if (!scratch[c]) return false;
+    }
+    return true;
 }
 
-void SingleThreadConvolver::set_normalisation(uint32_t norm_) {
-    norm = norm_;
+void MultiStageConvolver::reset()
+{
+    ready = false;
+    pro.stop();
+    bgStage = nullptr;
+    headStage = false;
+    directHead = false;
+    firHead.reset();
+    stages.clear();
+    routes.clear();
+    for (uint32_t c = 0; c < MAXCHANNELS; c++) scratch[c] = nullptr;
+    scratchSize = 0;
+    arena.rewind();
 }
 
-bool SingleThreadConvolver::configure(std::string fname, float gain, unsigned int delay, unsigned int offset,
+bool MultiStageConvolver::configure(std::string fname, float gain_, unsigned int delay, unsigned int offset,
             unsigned int length, unsigned int size, unsigned int bufsize)
 {
     filename = fname;
-    float* abuf = NULL;
-    uint32_t arate = 0;
-    int asize = 0;
-    if (!get_buffer(fname, &abuf, &arate, &asize)) {
-        return false;
-    }
-    normalize(abuf, asize);
-    uint32_t csize = 1024;
-    #ifdef __MOD_DEVICES__
-    csize = 256;
-    #endif
-    if (init(csize, abuf, asize)) {
+    misses = 0;
+    gain = gain_;
+    // reuse a prepared IR from the cache, when there
+    std::shared_ptr<const IrData> ir = IrReader::loadCached(fname, samplerate, shape,
+                                                            channelsIn, channelsOut);
+    if (!ir) return false;
+    const uint32_t len = irRange(ir->length, &offset, length);
+
+    if (init(*ir, delay, offset, len)) {
         ready = true;
-        delete[] abuf;
         return true;
     }
-    delete[] abuf;
+    reset();
     return false;
 }
 
-inline std::string SingleThreadConvolver::getIrFile() {
+inline std::string MultiStageConvolver::getIrFile() {
     return filename;
 }
 
-void SingleThreadConvolver::compute(int32_t count, float* input, float* output)
+void MultiStageConvolver::backgroundProcessing()
+{
+    if (!bgStage) return;
+    const float* in[MAXCHANNELS];
+    float* out[MAXCHANNELS];
+    for (uint32_t c = 0; c < channelsIn; c++) in[c] = bgStage->jobIn[c];
+    for (uint32_t c = 0; c < channelsOut; c++) out[c] = bgStage->jobOut[c];
+    if (bgStage->resync) {
+        bgStage->conv.clear();
+        bgStage->resync = false;
+    }
+    bgStage->conv.process(in, out, bgStage->blockSize);
+}
+
+void MultiStageConvolver::processStage(Stage* st, const float* const* input,
+                                       float* const* output, uint32_t count)
+{
+    uint32_t pos = 0;
+    while (pos < count) {
+        const uint32_t n = std::min(count - pos, st->blockSize - st->fill);
+        for (uint32_t c = 0; c < channelsIn; c++)
+            memcpy(&st->inBuf[c][st->fill], input[c] + pos, n * sizeof(float));
+        for (uint32_t c = 0; c < channelsOut; c++) {
+            const float* out = &st->outBuf[c][st->fill];
+            float* dst = output[c] + pos;
+            for (uint32_t i = 0; i < n; i++) {
+                dst[i] += out[i];
+            }
+        }
+        st->fill += n;
+        pos += n;
+        // block complete, compute the output for the next block
+        if (st->fill == st->blockSize) {
+            st->fill = 0;
+            if (st->background) {
+                // a job which missed the deadline still use the job buffers,
+                // so the stage stay silent for this block and the miss is counted.
+                // A late job isn't waited for again, it's only checked.
+                const bool done = st->late ? pro.getProcess() && pro.processWait()
+                                           : pro.processWait();
+                if (!done) {
+                    misses++;
+                    st->late = true;
+                    for (uint32_t c = 0; c < channelsOut; c++)
+                        memset(st->outBuf[c], 0, st->blockSize * sizeof(float));
+                    continue;
+                }
+                // the result of a late job is out of time, drop it
+                // and start the stage over with a empty history
+                if (st->late) {
+                    for (uint32_t c = 0; c < channelsOut; c++)
+                        memset(st->jobOut[c], 0, st->blockSize * sizeof(float));
+                    st->late = false;
+                    st->resync = true;
+                }
+                for (uint32_t c = 0; c < channelsOut; c++) std::swap(st->outBuf[c], st->jobOut[c]);
+                for (uint32_t c = 0; c < channelsIn; c++) std::swap(st->jobIn[c], st->inBuf[c]);
+                // the result is needed when the next block is complete
+                pro.runProcess(ThreadPool::now() +
+                    static_cast<uint64_t>(st->blockSize) * 1000000000ULL / std::max(samplerate, 1U));
+            } else {
+                const float* in[MAXCHANNELS];
+                float* out[MAXCHANNELS];
+                for (uint32_t c = 0; c < channelsIn; c++) in[c] = st->inBuf[c];
+                for (uint32_t c = 0; c < channelsOut; c++) out[c] = st->outBuf[c];
+                st->conv.process(in, out, st->blockSize);
+            }
+        }
+    }
+}
+
+void MultiStageConvolver::process(int32_t count, float* const* input, float* const* output)
+{
+    int32_t done = 0;
+    const int32_t chunk = static_cast<int32_t>(scratchSize);
+    while (done < count) {
+        const int32_t n = std::min(count - done, chunk);
+        const float* in[MAXCHANNELS];
+        float* out[MAXCHANNELS];
+        // keep the input, as we may process in place
+        for (uint32_t c = 0; c < channelsIn; c++) {
+            memcpy(scratch[c], input[c] + done, n * sizeof(float));
+            in[c] = scratch[c];
+        }
+        for (uint32_t c = 0; c < channelsOut; c++) out[c] = output[c] + done;
+        size_t first = 0;
+        if (headStage) {
+            stages[0]->conv.process(in, out, n);
+            first = 1;
+        } else if (directHead) {
+            firHead.process(in, out, n);
+        } else {
+            for (uint32_t c = 0; c < channelsOut; c++) memset(out[c], 0, n * sizeof(float));
+        }
+        for (size_t i = first; i < stages.size(); i++) {
+            processStage(stages[i].get(), in, out, n);
+        }
+        if (gain != 1.0f) {
+            for (uint32_t c = 0; c < channelsOut; c++) simd::scale(out[c], out[c], gain, n);
+        }
+        done += n;
+    }
+}
+
+void MultiStageConvolver::compute(int32_t count, float* input, float* output)
+{
+    if (!ready || channelsOut != 1) return;
+    process(count, &input, &output);
+}
+
+// with a single input, input1 is ignored
+void MultiStageConvolver::compute_stereo(int32_t count, float* input0, float* input1,
+                                         float* output0, float* output1)
 {
-    if (ready) process(input, output, count);
+    if (!ready || channelsOut != 2) return;
+    float* input[MAXCHANNELS] = {input0, input1};
+    float* output[MAXCHANNELS] = {output0, output1};
+    process(count, input, output);
 }
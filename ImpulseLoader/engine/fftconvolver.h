@@ -34,15 +34,28 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include <sndfile.hh>
 
 #include "TwoStageFFTConvolver.h"
-#include "ParallelThread.h"
+#include "arena.h"
+#include "partconvolver.h"
+#include "firfilter.h"
+#include "ircache.h"
+#include "irreader.h"
+#include "planner.h"
+#include "simd.h"
+#include "threadpool.h"
 #include "gx_resampler.h"
 
 
 /****************************************************************
- ** Audiofile - class to handle audio file read
+ ** Audiofile - class to handle audio file read, plain RIFF/WAVE
+ *              PCM 16/24/32 bit and float files (WAVE_FORMAT_EXTENSIBLE
+ *              as well) are read from a memory mapping, any other
+ *              format through libsndfile
  */
 
 class Audiofile {
@@ -91,9 +104,12 @@ public:
     int seek(unsigned int posit);
     int read(float *data, unsigned int frames);
 
+    bool is_mapped(void) const { return _map != nullptr; }
+
 private:
 
     void reset(void);
+    bool open_mapped(const std::string& name);
 
     SNDFILE     *_sndfile;
     int          _type;
@@ -101,6 +117,12 @@ private:
     int          _rate;
     int          _chan;
     unsigned int _size;
+    // the mapped file, the sample data and the read position in frames
+    void          *_map;
+    size_t         _mapSize;
+    const uint8_t *_data;
+    unsigned int   _frameBytes;
+    unsigned int   _pos;
 };
 
 /****************************************************************
@@ -111,18 +133,24 @@ class ConvolverBase
 {
 public:
     virtual bool start(int32_t policy, int32_t priority) {return true;}
-    virtual void set_normalisation(uint32_t norm) {}
-    virtual uint32_t get_normalisation() { return 0;}
+    virtual void set_shape(uint32_t shape) {}
     virtual bool configure(std::string fname, float gain, unsigned int delay,
                             unsigned int offset, unsigned int length,
                             unsigned int size, unsigned int bufsize) {return false;}
     virtual inline std::string getIrFile() { return "";}
     virtual void compute(int32_t count, float* input, float *output) {}
+    virtual void compute_stereo(int32_t count, float* input0, float* input1,
+                                float *output0, float *output1) {}
     virtual bool checkstate() { return true;}
     virtual inline void set_not_runnable() {}
     virtual inline bool is_runnable() { return false;}
     virtual inline void set_buffersize(uint32_t sz) {}
     virtual void set_samplerate(uint32_t sr) {}
+    // the partition layout to use, from the Planner
+    virtual void set_plan(const ConvPlan& plan_) {}
+    virtual void set_channels(uint32_t inputs, uint32_t outputs) {}
+    // the count of tail blocks which missed there deadline since the last call
+    virtual uint32_t take_misses() { return 0;}
     virtual int stop_process() {return 0;}
     virtual int cleanup() {return 0;}
 
@@ -131,27 +159,18 @@ public:
 };
 
 /****************************************************************
- ** DoubleThreadConvolver - convolver for larger IR files, using a background thread to handle the tail
+ ** DoubleThreadConvolver - convolver for larger IR files, the base class run the head
+ *                          and the first tail block, the rest of the tail is handed
+ *                          to the ThreadPool
  */
 
 class DoubleThreadConvolver: public ConvolverBase, public fftconvolver::TwoStageFFTConvolver
 {
 public:
-    std::mutex mo;
-    std::condition_variable co;
     bool start(int32_t policy, int32_t priority) override {
-        if (!pro.isRunning()) {
-            pro.start(); 
-            pro.setThreadName("Convolver");
-            pro.setPriority(25, 1); //SCHED_FIFO
-            pro.setTimeOut(200);
-            pro.set<DoubleThreadConvolver, &DoubleThreadConvolver::backgroundProcessing>(this);
-        }
         return ready;}
 
-    void set_normalisation(uint32_t norm) override;
-
-    uint32_t get_normalisation() override { return norm;}
+    void set_shape(uint32_t shape_) override { shape = shape_;}
 
     bool configure(std::string fname, float gain, unsigned int delay, unsigned int offset,
                     unsigned int length, unsigned int size, unsigned int bufsize) override;
@@ -170,37 +189,62 @@ public:
 
     inline void set_samplerate(uint32_t sr) override { samplerate = sr;}
 
+    void set_plan(const ConvPlan& plan_) override { plan = plan_;}
+
+    uint32_t take_misses() override {
+            const uint32_t m = misses;
+            misses = 0;
+            return m;}
+
     int stop_process() override {
             ready = false;
             return 0;}
 
     int cleanup () override {
+            pro.stop();
             reset();
+            bgConv.reset();
+            bgTail = false;
             return 0;}
 
     DoubleThreadConvolver()
-        : resamp(), ready(false), samplerate(0), pro() {
-            norm = 0;}
+        : ready(false), samplerate(0), gain(1.0f), tailTime(0), misses(0), pro(),
+          bgTail(false), bgFill(0), late(false), resync(false),
+          inBuf(nullptr), outBuf(nullptr), jobIn(nullptr), jobOut(nullptr) {
+            shape = 0;
+            pro.set<DoubleThreadConvolver, &DoubleThreadConvolver::backgroundProcessing>(this);}
 
-    ~DoubleThreadConvolver() { reset(); pro.stop();}
-
-protected:
-    void startBackgroundProcessing() override;
-    void waitForBackgroundProcessing() override;
+    ~DoubleThreadConvolver() { pro.stop(); reset();}
 
 private:
-    friend class ParallelThread;
-    gx_resample::BufferResampler resamp;
-    void backgroundProcessing() { return doBackgroundProcessing();}
+    void backgroundProcessing();
+    void swapTail();
     volatile bool ready;
     uint32_t buffersize;
     uint32_t samplerate;
-    uint32_t norm;
+    uint32_t shape;
+    float gain;
+    ConvPlan plan;
     std::string filename;
-    ParallelThread pro;
-    std::atomic<bool> setWait;
-    bool get_buffer(std::string fname, float **buffer, uint32_t* rate, int* size);
-    void normalize(float* buffer, int asize);
+    // ns until the tail is needed, the deadline of the job
+    uint64_t tailTime;
+    uint32_t misses;
+    PoolJob pro;
+    // the IR from twice the tail size on, in blocks of the tail size,
+    // it's output is one block late like a background stage of the
+    // MultiStageConvolver
+    PartitionConvolver bgConv;
+    ScratchArena arena;
+    bool bgTail;
+    uint32_t bgFill;
+    // the job missed the deadline and still hold the job buffers
+    bool late;
+    // the job should start with a empty history
+    bool resync;
+    float* inBuf;
+    float* outBuf;
+    float* jobIn;
+    float* jobOut;
 };
 
 /****************************************************************
@@ -213,9 +257,7 @@ public:
     bool start(int32_t policy, int32_t priority) override {
         return ready;}
 
-    void set_normalisation(uint32_t norm) override;
-
-    uint32_t get_normalisation() override { return norm;}
+    void set_shape(uint32_t shape_) override { shape = shape_;}
 
     bool configure(std::string fname, float gain, unsigned int delay, unsigned int offset,
                     unsigned int length, unsigned int size, unsigned int bufsize) override;
@@ -234,6 +276,8 @@ public:
 
     inline void set_samplerate(uint32_t sr) override { samplerate = sr;}
 
+    void set_plan(const ConvPlan& plan_) override { plan = plan_;}
+
     int stop_process() override {
             ready = false;
             return 0;}
@@ -243,23 +287,200 @@ public:
             return 0;}
 
     SingleThreadConvolver()
-        : resamp(), ready(false), samplerate(0) { norm = 0;}
+        : ready(false), samplerate(0), gain(1.0f) { shape = 0;}
 
     ~SingleThreadConvolver() { reset();}
 
 private:
-    gx_resample::BufferResampler resamp;
     volatile bool ready;
     uint32_t buffersize;
     uint32_t samplerate;
-    uint32_t norm;
+    uint32_t shape;
+    float gain;
+    ConvPlan plan;
+    std::string filename;
+};
+
+/****************************************************************
+ ** FirConvolver - direct form FIR for short IR files, like guitar cabinets,
+ *                 zero latency and no FFT on each process call
+ */
+
+class FirConvolver: public ConvolverBase
+{
+public:
+    bool start(int32_t policy, int32_t priority) override {
+        return ready;}
+
+    void set_shape(uint32_t shape_) override { shape = shape_;}
+
+    bool configure(std::string fname, float gain, unsigned int delay, unsigned int offset,
+                    unsigned int length, unsigned int size, unsigned int bufsize) override;
+
+    inline std::string getIrFile() override;
+
+    void compute(int32_t count, float* input, float *output) override;
+
+    bool checkstate() override { return true;}
+
+    inline void set_not_runnable() override { ready = false;}
+
+    inline bool is_runnable() override { return ready;}
+
+    inline void set_buffersize(uint32_t sz) override { buffersize = sz;}
+
+    inline void set_samplerate(uint32_t sr) override { samplerate = sr;}
+
+    void set_plan(const ConvPlan& plan_) override { plan = plan_;}
+
+    int stop_process() override {
+            ready = false;
+            return 0;}
+
+    int cleanup () override {
+            fir.reset();
+            arena.rewind();
+            return 0;}
+
+    FirConvolver()
+        : ready(false), buffersize(0), samplerate(0), gain(1.0f) { shape = 0;}
+
+    ~FirConvolver() { fir.reset();}
+
+private:
+    volatile bool ready;
+    uint32_t buffersize;
+    uint32_t samplerate;
+    uint32_t shape;
+    float gain;
+    ConvPlan plan;
+    std::string filename;
+    // the taps and the history, kept for the next IR
+    ScratchArena arena;
+    FirFilter fir;
+};
+
+/****************************************************************
+ ** MultiStageConvolver - non-uniform partitioned convolver for long IR files,
+ *                        stages with growing partition sizes, each stage run
+ *                        at it's own cadence, the last stage in the ThreadPool.
+ *                        Handle as well the stereo and true stereo modes
+ *                        and the IR pre-delay.
+ */
+
+class MultiStageConvolver: public ConvolverBase
+{
+public:
+    bool start(int32_t policy, int32_t priority) override;
+
+    void set_shape(uint32_t shape_) override { shape = shape_;}
+
+    bool configure(std::string fname, float gain, unsigned int delay, unsigned int offset,
+                    unsigned int length, unsigned int size, unsigned int bufsize) override;
+
+    inline std::string getIrFile() override;
+
+    void compute(int32_t count, float* input, float *output) override;
+
+    void compute_stereo(int32_t count, float* input0, float* input1,
+                        float *output0, float *output1) override;
+
+    bool checkstate() override { return true;}
+
+    inline void set_not_runnable() override { ready = false;}
+
+    inline bool is_runnable() override { return ready;}
+
+    inline void set_buffersize(uint32_t sz) override { buffersize = sz;}
+
+    inline void set_samplerate(uint32_t sr) override { samplerate = sr;}
+
+    void set_plan(const ConvPlan& plan_) override { plan = plan_;}
+
+    void set_channels(uint32_t inputs, uint32_t outputs) override {
+            channelsIn = std::min(std::max(inputs, 1U), MAXCHANNELS);
+            channelsOut = std::min(std::max(outputs, 1U), MAXCHANNELS);}
+
+    uint32_t take_misses() override {
+            const uint32_t m = misses;
+            misses = 0;
+            return m;}
+
+    int stop_process() override {
+            ready = false;
+            return 0;}
+
+    int cleanup () override {
+            reset();
+            return 0;}
+
+    MultiStageConvolver()
+        : ready(false), buffersize(0), samplerate(0), gain(1.0f), channelsIn(1),
+          channelsOut(1), misses(0), pro(), scratch{nullptr, nullptr}, scratchSize(0),
+          headStage(false), directHead(false), bgStage(nullptr) {
+            shape = 0;
+            pro.set<MultiStageConvolver, &MultiStageConvolver::backgroundProcessing>(this);}
+
+    ~MultiStageConvolver() { pro.stop(); reset();}
+
+private:
+    static constexpr uint32_t MAXCHANNELS = 2;
+    // the IR files channel used for the path from input to output
+    struct Route {
+        uint32_t input;
+        uint32_t output;
+        uint32_t channel;
+    };
+
+    struct Stage {
+        PartitionConvolver conv;
+        uint32_t blockSize;
+        uint32_t fill;
+        bool background;
+        // the job missed the deadline and still hold the job buffers
+        bool late;
+        // the job should start with a empty history
+        bool resync;
+        float* inBuf[MAXCHANNELS];
+        float* outBuf[MAXCHANNELS];
+        float* jobIn[MAXCHANNELS];
+        float* jobOut[MAXCHANNELS];
+    };
+
+    volatile bool ready;
+    uint32_t buffersize;
+    uint32_t samplerate;
+    uint32_t shape;
+    float gain;
+    uint32_t channelsIn;
+    uint32_t channelsOut;
+    uint32_t misses;
+    ConvPlan plan;
     std::string filename;
-    bool get_buffer(std::string fname, float **buffer, uint32_t* rate, int* size);
-    void normalize(float* buffer, int asize);
+    PoolJob pro;
+    std::vector<std::unique_ptr<Stage> > stages;
+    std::vector<Route> routes;
+    // all buffers used in process(), kept for the next IR
+    ScratchArena arena;
+    float* scratch[MAXCHANNELS];
+    uint32_t scratchSize;
+    // the first stage run zero latency, it's missing when the pre-delay cover it
+    bool headStage;
+    // or the start of the IR run as FIR in front of the stages
+    bool directHead;
+    FirFilter firHead;
+    Stage* bgStage;
+    void backgroundProcessing();
+    void processStage(Stage* st, const float* const* input, float* const* output, uint32_t count);
+    void process(int32_t count, float* const* input, float* const* output);
+    void setRoutes(uint32_t irChannels);
+    bool init(const IrData& ir, uint32_t delay, uint32_t offset, uint32_t length);
+    void reset();
 };
 
 /****************************************************************
- ** ConvolverSelector - class to select the convolver to use based on the file size
+ ** ConvolverSelector - class to select the convolver to use, planned
+ *                      from the IR length and the host block size
  */
 
 class ConvolverSelector
@@ -268,14 +489,33 @@ public:
     bool start(int32_t policy, int32_t priority) {
             return conv->start(policy, priority);}
 
-    void set_normalisation(uint32_t norm) {
-            sconv.set_normalisation(norm);
-            dconv.set_normalisation(norm);}
+    // the gain for the normalisation mode, from the statistics of the loaded IR
+    float get_normalisation(uint32_t norm) { return norm ? normGain[1] : normGain[0];}
 
-    uint32_t get_normalisation() { 
-        return conv->get_normalisation();
-    }
+    // the IrShape flags, trimming and minimum phase
+    void set_shape(uint32_t shape_) {
+            shape = shape_;
+            sconv.set_shape(shape);
+            dconv.set_shape(shape);
+            msconv.set_shape(shape);
+            fconv.set_shape(shape);}
+
+    // the length of the IR in use, and of the file before it was trimmed
+    uint32_t get_ir_length() { return irLength;}
+
+    // the fallback after the tail missed it's deadline, and how often
+    // the IR is cut in half as the process thread run out of time
+    void set_fallback(uint32_t fallback_, uint32_t shorten_) {
+            fallback = fallback_;
+            shorten = shorten_;}
 
+    uint32_t take_misses() {
+            return conv->take_misses();}
+
+    uint32_t get_source_length() { return sourceLength;}
+
+    // gain is a linear factor, delay, offset and length are in samples,
+    // a length of 0 use the IR up to the end
     bool configure(std::string fname, float gain, unsigned int delay,
                             unsigned int offset, unsigned int length,
                             unsigned int size, unsigned int bufsize);
@@ -287,6 +527,10 @@ public:
     void compute(int32_t count, float* input, float *output) {
             conv->compute(count, input, output);}
 
+    void compute_stereo(int32_t count, float* input0, float* input1,
+                        float *output0, float *output1) {
+            conv->compute_stereo(count, input0, input1, output0, output1);}
+
     bool checkstate() {
             return conv->checkstate();}
 
@@ -297,12 +541,24 @@ public:
             return conv->is_runnable();}
 
     inline void set_buffersize(uint32_t sz) {
+            buffersize = sz;
             sconv.set_buffersize(sz);
-            dconv.set_buffersize(sz);}
+            dconv.set_buffersize(sz);
+            msconv.set_buffersize(sz);
+            fconv.set_buffersize(sz);}
 
     void set_samplerate(uint32_t sr) {
+            samplerate = sr;
             sconv.set_samplerate(sr);
-            dconv.set_samplerate(sr);}
+            dconv.set_samplerate(sr);
+            msconv.set_samplerate(sr);
+            fconv.set_samplerate(sr);}
+
+    // the stereo modes are handled by the multi stage convolver
+    void set_channels(uint32_t inputs, uint32_t outputs) {
+            channelsIn = inputs;
+            channelsOut = outputs;
+            msconv.set_channels(inputs, outputs);}
 
     int stop_process() {
             return conv->stop_process();}
@@ -311,9 +567,20 @@ public:
             return conv->cleanup();}
 
     ConvolverSelector():
+            buffersize(0),
+            samplerate(0),
+            normGain{1.0f, 1.0f},
+            shape(0),
+            irLength(0),
+            sourceLength(0),
+            channelsIn(1),
+            channelsOut(1),
+            fallback(0),
+            shorten(0),
             sconv(),
-            dconv(){        
-            dconv.start(25, 1);
+            dconv(),
+            msconv(),
+            fconv(){
             conv = &sconv;
             }
 
@@ -321,8 +588,20 @@ public:
     
 private:
     ConvolverBase *conv;
+    uint32_t buffersize;
+    uint32_t samplerate;
+    float normGain[2];
+    uint32_t shape;
+    uint32_t irLength;
+    uint32_t sourceLength;
+    uint32_t channelsIn;
+    uint32_t channelsOut;
+    uint32_t fallback;
+    uint32_t shorten;
     SingleThreadConvolver sconv;
     DoubleThreadConvolver dconv;
+    MultiStageConvolver msconv;
+    FirConvolver fconv;
 };
 
 #endif  // FFTCONVOLVER_H_
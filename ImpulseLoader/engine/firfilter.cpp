@@ -0,0 +1,89 @@
+/*
+ * firfilter.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "firfilter.h"
+#include "simd.h"
+#include <string.h>
+#include <algorithm>
+
+
+/****************************************************************
+ ** FirFilter
+ */
+
+// the taps are stored reversed, so each output is a dot product
+// over the history running forward, output i of a block use the
+// history samples start + i .. start + i + length - 1
+bool FirFilter::init(const std::vector<FirPath>& paths, uint32_t inputs, uint32_t outputs,
+                     uint32_t maxBlock, ScratchArena* arena)
+{
+    reset();
+    if (paths.empty() || !inputs || !outputs || !arena) return false;
+    _span = 1;
+    for (const FirPath& p : paths) {
+        if (p.input >= inputs || p.output >= outputs || (p.length && !p.ir)) return false;
+        _span = std::max(_span, p.lead + p.length);
+    }
+    for (const FirPath& p : paths) {
+        if (!p.length) continue;
+        Taps t;
+        t.input = p.input;
+        t.output = p.output;
+        t.start = _span - p.lead - p.length;
+        t.length = p.length;
+        t.taps = arena->alloc(p.length);
+        if (!t.taps) {
+            reset();
+            return false;
+        }
+        for (uint32_t i = 0; i < p.length; i++) t.taps[i] = p.ir[p.length - 1 - i];
+        _paths.push_back(t);
+    }
+    _outputs = outputs;
+    _block = std::max(maxBlock, 64U);
+    for (uint32_t c = 0; c < inputs; c++) {
+        float* h = arena->alloc(_span - 1 + _block);
+        if (!h) {
+            reset();
+            return false;
+        }
+        _history.push_back(h);
+    }
+    return true;
+}
+
+void FirFilter::reset()
+{
+    _paths.clear();
+    _history.clear();
+    _outputs = 0;
+    _span = 0;
+    _block = 0;
+}
+
+void FirFilter::process(const float* const* inputs, float* const* outputs, uint32_t len)
+{
+    if (!_span) return;
+    const uint32_t keep = _span - 1;
+    uint32_t done = 0;
+    while (done < len) {
+        const uint32_t n = std::min(len - done, _block);
+        // keep the input, as we may process in place
+        for (size_t c = 0; c < _history.size(); c++)
+            memcpy(_history[c] + keep, inputs[c] + done, n * sizeof(float));
+        for (uint32_t c = 0; c < _outputs; c++)
+            memset(outputs[c] + done, 0, n * sizeof(float));
+        for (const Taps& t : _paths)
+            simd::fir(outputs[t.output] + done, _history[t.input] + t.start,
+                      t.taps, t.length, n);
+        for (float* h : _history)
+            memmove(h, h + n, keep * sizeof(float));
+        done += n;
+    }
+}
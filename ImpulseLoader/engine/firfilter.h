@@ -0,0 +1,77 @@
+/*
+ * firfilter.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef FIRFILTER_H_
+#define FIRFILTER_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "arena.h"
+
+
+/****************************************************************
+ ** FirPath - route one input through the first samples of a IR
+ *            into one output, lead zeros are placed before the IR
+ */
+
+struct FirPath
+{
+    uint32_t input;
+    uint32_t output;
+    const float* ir;
+    uint32_t length;
+    uint32_t lead;
+};
+
+/****************************************************************
+ ** FirFilter - direct form FIR in the time domain, zero latency.
+ *              For short IRs and the first part of long ones it's
+ *              cheaper then a FFT on each process call. The taps are
+ *              copied into the arena, so the IR could be released after init().
+ */
+
+class FirFilter
+{
+public:
+    // maxBlock is the largest block processed at once, larger ones are split.
+    // The taps and the history are taken from the arena.
+    bool init(const std::vector<FirPath>& paths, uint32_t inputs, uint32_t outputs,
+              uint32_t maxBlock, ScratchArena* arena);
+    // process len samples, inputs and outputs may point to the same buffers
+    void process(const float* const* inputs, float* const* outputs, uint32_t len);
+    void reset();
+
+    // the IR samples covered, with the lead zeros
+    inline uint32_t span() const { return _span;}
+
+    FirFilter() : _outputs(0), _span(0), _block(0) {}
+    ~FirFilter() {}
+
+private:
+    struct Taps {
+        uint32_t input;
+        uint32_t output;
+        // the first history sample used, the taps skip the lead zeros
+        uint32_t start;
+        uint32_t length;
+        float* taps;
+    };
+
+    std::vector<Taps> _paths;
+    // the last span - 1 input samples in front of the current block
+    std::vector<float*> _history;
+    uint32_t _outputs;
+    uint32_t _span;
+    uint32_t _block;
+};
+
+#endif  // FIRFILTER_H_
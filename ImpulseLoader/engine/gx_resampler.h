@@ -82,6 +82,10 @@ public:
   {
     return (i_size * ratio_b) / ratio_a + 1;
   }
+  int32_t get_max_flush_size()
+  {
+    return get_max_out_size(inpsize()/2);
+  }
   int32_t process(int32_t count, float *input, float *output);
   int32_t flush(float *output); // check source for max. output size
 };
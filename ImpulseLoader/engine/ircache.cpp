@@ -0,0 +1,651 @@
+/*
+ * ircache.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "ircache.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+
+/****************************************************************
+ ** IrKey
+ */
+
+std::string IrKey::str() const
+{
+    return path + "|" + std::to_string(mtime) + "|" + std::to_string(fsize) +
+        "|" + std::to_string(rate) + "|" + std::to_string(shape) + "|" + std::to_string(inputs) + "|" + std::to_string(outputs);
+}
+
+/****************************************************************
+ ** IrData
+ */
+
+size_t IrData::bytes() const
+{
+    size_t b = sizeof(IrData);
+    for (const std::vector<float>& c : channels) b += c.size() * sizeof(float);
+    return b;
+}
+
+bool IrData::sameContent(const IrData& other) const
+{
+    return length == other.length && sourceLength == other.sourceLength &&
+        channels == other.channels;
+}
+
+// FNV-1a over the sample words, good enough to find equal IRs,
+// sameContent() catch the collisions
+static uint64_t contentHash(const IrData& ir)
+{
+    uint64_t h = 14695981039346656037ULL;
+    h = (h ^ ir.length) * 1099511628211ULL;
+    h = (h ^ ir.sourceLength) * 1099511628211ULL;
+    h = (h ^ ir.channels.size()) * 1099511628211ULL;
+    for (const std::vector<float>& c : ir.channels) {
+        const uint32_t* w = reinterpret_cast<const uint32_t*>(c.data());
+        for (size_t i = 0; i < c.size(); i++) {
+            h = (h ^ w[i]) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+/****************************************************************
+ ** IrCache
+ */
+
+IrCache::IrCache()
+    : usedBytes(0), useDisk(true) {
+    budgetBytes = 256 * 1024 * 1024;
+    #ifdef __MOD_DEVICES__
+    budgetBytes = 32 * 1024 * 1024;
+    #endif
+    #ifdef _WIN32
+    useDisk = false;
+    #endif
+    const char* env = getenv("IMPULSELOADER_NO_DISK_CACHE");
+    if (env && *env && strcmp(env, "0") != 0) useDisk = false;
+}
+
+IrCache& IrCache::instance()
+{
+    static IrCache cache;
+    return cache;
+}
+
+bool IrCache::makeKey(const std::string& path, uint32_t rate, uint32_t shape,
+                      uint32_t inputs, uint32_t outputs, IrKey* key)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    key->path = path;
+    key->mtime = static_cast<int64_t>(st.st_mtime);
+    key->fsize = static_cast<int64_t>(st.st_size);
+    key->rate = rate;
+    key->shape = shape;
+    key->inputs = inputs;
+    key->outputs = outputs;
+    return true;
+}
+
+// the spectra depend on the FFT implementation in use
+const char* IrCache::fftTag()
+{
+    return fft::backendName();
+}
+
+// keyed by the IR content, so the same IR loaded from a other file,
+// or with other settings resulting in the same data, share the spectra.
+// The lead is only added when used, so the keys without stay the same.
+std::string IrCache::partitionKey(const IrData& ir, uint32_t channel,
+                    uint32_t blockSize, uint32_t offset, uint32_t length,
+                    uint32_t lead)
+{
+    char hash[20];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)ir.hash);
+    std::string key = std::string("p|") + hash + "|" + std::to_string(ir.length) +
+        "|" + std::to_string(ir.channels.size()) + "|" + fftTag() +
+        "|" + std::to_string(channel) + "|" + std::to_string(blockSize) +
+        "|" + std::to_string(offset) + "|" + std::to_string(length);
+    if (lead) key += "|" + std::to_string(lead);
+    return key;
+}
+
+IrCache::Entry* IrCache::find(const std::string& key)
+{
+    auto it = entries.find(key);
+    if (it == entries.end()) return nullptr;
+    // move to the front of the LRU list
+    lru.splice(lru.begin(), lru, it->second.lru);
+    return &it->second;
+}
+
+void IrCache::insert(const std::string& key, Entry entry)
+{
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        usedBytes -= it->second.bytes;
+        lru.erase(it->second.lru);
+        entries.erase(it);
+    }
+    Live& l = live[key];
+    if (entry.ir) l.ir = entry.ir;
+    if (entry.part) l.part = entry.part;
+    lru.push_front(key);
+    entry.lru = lru.begin();
+    usedBytes += entry.bytes;
+    entries.emplace(key, std::move(entry));
+    evict(key);
+    pruneLive();
+}
+
+// drop the least recently used entries until we fit in the budget,
+// data still in use by a convolver is freed when it's released
+void IrCache::evict(const std::string& keep)
+{
+    while (usedBytes > budgetBytes && !lru.empty()) {
+        const std::string& last = lru.back();
+        if (last == keep) break;
+        auto it = entries.find(last);
+        usedBytes -= it->second.bytes;
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+// forget the released data, once the registry grow larger then the LRU
+void IrCache::pruneLive()
+{
+    if (live.size() < 2 * entries.size() + 64) return;
+    for (auto it = live.begin(); it != live.end();) {
+        if (it->second.ir.expired() && it->second.part.expired()) it = live.erase(it);
+        else ++it;
+    }
+    for (auto it = contents.begin(); it != contents.end();) {
+        if (it->second.expired()) it = contents.erase(it);
+        else ++it;
+    }
+}
+
+// return the shared copy when a IR with the same content is alive,
+// otherwise register this one
+std::shared_ptr<const IrData> IrCache::share(std::shared_ptr<IrData> ir)
+{
+    auto it = contents.find(ir->hash);
+    if (it != contents.end()) {
+        std::shared_ptr<const IrData> other = it->second.lock();
+        if (other && other->sameContent(*ir)) return other;
+    }
+    contents[ir->hash] = ir;
+    return ir;
+}
+
+std::shared_ptr<const IrData> IrCache::lookupIr(const std::string& key)
+{
+    Entry* e = find(key);
+    if (e) return e->ir;
+    Entry entry;
+    // still held by a instance, but gone from the LRU
+    auto it = live.find(key);
+    if (it != live.end()) entry.ir = it->second.ir.lock();
+    if (!entry.ir && useDisk) {
+        std::shared_ptr<IrData> ir = readIr(key);
+        if (ir) {
+            ir->hash = contentHash(*ir);
+            entry.ir = share(ir);
+        }
+    }
+    if (!entry.ir) return nullptr;
+    entry.bytes = entry.ir->bytes();
+    insert(key, entry);
+    return entry.ir;
+}
+
+std::shared_ptr<const IrPartitions> IrCache::lookupPartitions(const std::string& key,
+                        uint32_t blockSize)
+{
+    Entry* e = find(key);
+    if (e) return e->part;
+    Entry entry;
+    auto it = live.find(key);
+    if (it != live.end()) entry.part = it->second.part.lock();
+    if (!entry.part && useDisk) entry.part = readPartitions(key);
+    if (!entry.part || entry.part->blockSize() != blockSize) return nullptr;
+    entry.bytes = entry.part->bytes();
+    insert(key, entry);
+    return entry.part;
+}
+
+void IrCache::waitLoading(std::unique_lock<std::mutex>& lock, const std::string& key)
+{
+    loaded.wait(lock, [&] { return loading.count(key) == 0; });
+}
+
+void IrCache::doneLoading(const std::string& key)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loading.erase(key);
+    }
+    loaded.notify_all();
+}
+
+std::shared_ptr<const IrData> IrCache::findIr(const IrKey& key)
+{
+    const std::string k = key.str();
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookupIr(k);
+}
+
+std::shared_ptr<const IrData> IrCache::insertIr(const IrKey& key,
+                        const std::vector<float*>& buffer, const IrStats& stats)
+{
+    std::shared_ptr<IrData> ir = std::make_shared<IrData>();
+    ir->length = stats.length;
+    ir->sourceLength = std::max(stats.sourceLength, stats.length);
+    ir->peak = stats.peak;
+    ir->energy = stats.energy;
+    ir->channels.resize(buffer.size());
+    for (size_t c = 0; c < buffer.size(); c++) {
+        ir->channels[c].assign(buffer[c], buffer[c] + stats.length);
+    }
+    ir->hash = contentHash(*ir);
+    const std::string k = key.str();
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry entry;
+    entry.ir = share(ir);
+    entry.bytes = entry.ir->bytes();
+    insert(k, entry);
+    if (useDisk) writeIr(k, *entry.ir);
+    return entry.ir;
+}
+
+std::shared_ptr<const IrData> IrCache::loadIr(const IrKey& key, const IrLoader& load)
+{
+    const std::string k = key.str();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waitLoading(lock, k);
+        std::shared_ptr<const IrData> ir = lookupIr(k);
+        if (ir) return ir;
+        loading.insert(k);
+    }
+    std::vector<float*> buffer;
+    IrStats stats;
+    std::shared_ptr<const IrData> ir;
+    if (load(&buffer, &stats) && stats.length)
+        ir = insertIr(key, buffer, stats);
+    for (float* b : buffer) delete[] b;
+    doneLoading(k);
+    return ir;
+}
+
+std::shared_ptr<const IrPartitions> IrCache::findPartitions(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead)
+{
+    const std::string k = partitionKey(ir, channel, blockSize, offset, length, lead);
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookupPartitions(k, blockSize);
+}
+
+std::shared_ptr<const IrPartitions> IrCache::insertPartitions(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead, std::shared_ptr<const IrPartitions> part)
+{
+    if (!part) return part;
+    Entry entry;
+    entry.part = part;
+    entry.bytes = part->bytes();
+    const std::string k = partitionKey(ir, channel, blockSize, offset, length, lead);
+    std::lock_guard<std::mutex> lock(mutex);
+    insert(k, std::move(entry));
+    if (useDisk) writePartitions(k, *part);
+    return part;
+}
+
+std::shared_ptr<const IrPartitions> IrCache::loadPartitions(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead)
+{
+    if (channel >= ir.channels.size() || offset + length > ir.length) return nullptr;
+    const std::string k = partitionKey(ir, channel, blockSize, offset, length, lead);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waitLoading(lock, k);
+        std::shared_ptr<const IrPartitions> part = lookupPartitions(k, blockSize);
+        if (part) return part;
+        loading.insert(k);
+    }
+    std::shared_ptr<IrPartitions> p = std::make_shared<IrPartitions>();
+    std::shared_ptr<const IrPartitions> part;
+    if (p->init(blockSize, ir.channels[channel].data() + offset, length, lead))
+        part = insertPartitions(ir, channel, blockSize, offset, length, lead, p);
+    doneLoading(k);
+    return part;
+}
+
+void IrCache::setBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budgetBytes = bytes;
+    evict(std::string());
+}
+
+size_t IrCache::budget()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return budgetBytes;
+}
+
+size_t IrCache::used()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedBytes;
+}
+
+// drop the LRU, data still in use stay shared by the instances holding it
+void IrCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    usedBytes = 0;
+    pruneLive();
+}
+
+void IrCache::setDiskCache(bool enable)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    #ifdef _WIN32
+    enable = false;
+    #endif
+    useDisk = enable;
+}
+
+bool IrCache::diskCache()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return useDisk;
+}
+
+/****************************************************************
+ ** IrCache - the on-disk cache
+ *
+ *  One file per entry, named by a hash of the key. The file start
+ *  with a header, followed by the full key (to catch hash collisions)
+ *  and the float data, aligned to 64 byte, so it could be used
+ *  directly from the mapped file.
+ */
+
+namespace {
+
+enum {
+    CACHE_IR = 1,
+    CACHE_PARTITIONS = 2
+};
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t type;
+    uint32_t keyLength;
+    // IR: channels, length, source length, the channels are followed by peak and energy;
+    // partitions: block size, complex size, count
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t dataOffset;
+};
+
+static const char cacheMagic[4] = {'I', 'L', 'C', 'F'};
+// 2: the IR is stored for both normalisation modes, with it's statistics
+static const uint32_t cacheVersion = 2;
+
+static uint64_t hashKey(const std::string& key)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char ch : key) {
+        h ^= ch;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#ifndef _WIN32
+// a read only mapped cache file
+struct MappedFile {
+    void* data;
+    size_t size;
+    MappedFile() : data(MAP_FAILED), size(0) {}
+    ~MappedFile() { if (data != MAP_FAILED) munmap(data, size);}
+};
+
+static std::shared_ptr<MappedFile> mapFile(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHeader)) {
+        close(fd);
+        return nullptr;
+    }
+    std::shared_ptr<MappedFile> m = std::make_shared<MappedFile>();
+    m->size = st.st_size;
+    m->data = mmap(nullptr, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m->data == MAP_FAILED) return nullptr;
+    return m;
+}
+
+// check the header and the key, return the header when the file match
+static const CacheHeader* checkFile(const MappedFile& m, const std::string& key,
+                                    uint32_t type, size_t dataSize)
+{
+    const CacheHeader* h = static_cast<const CacheHeader*>(m.data);
+    if (memcmp(h->magic, cacheMagic, 4) != 0 || h->version != cacheVersion ||
+        h->type != type || h->keyLength != key.size()) return nullptr;
+    if (sizeof(CacheHeader) + key.size() > m.size ||
+        memcmp(reinterpret_cast<const char*>(h + 1), key.data(), key.size()) != 0) return nullptr;
+    if (h->dataOffset % 64 != 0 || h->dataOffset + dataSize > m.size) return nullptr;
+    return h;
+}
+
+static bool makeDirs(const std::string& dir)
+{
+    std::string p;
+    size_t pos = 0;
+    while (pos != std::string::npos) {
+        pos = dir.find('/', pos + 1);
+        p = dir.substr(0, pos);
+        if (p.empty()) continue;
+        if (mkdir(p.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+// write to a temporary file and rename it, so readers never see a partly written file
+static bool writeFile(const std::string& path, const std::string& key, uint32_t type,
+                      uint32_t a, uint32_t b, uint32_t c,
+                      const std::vector<std::pair<const float*, size_t> >& blocks)
+{
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos || !makeDirs(path.substr(0, slash))) return false;
+    CacheHeader h;
+    memcpy(h.magic, cacheMagic, 4);
+    h.version = cacheVersion;
+    h.type = type;
+    h.keyLength = key.size();
+    h.a = a;
+    h.b = b;
+    h.c = c;
+    h.dataOffset = ((sizeof(CacheHeader) + key.size() + 63) / 64) * 64;
+
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(key.data(), 1, key.size(), f) == key.size();
+    static const char pad[64] = {0};
+    const size_t padding = h.dataOffset - sizeof(CacheHeader) - key.size();
+    if (ok && padding) ok = fwrite(pad, 1, padding, f) == padding;
+    for (const auto& blk : blocks) {
+        if (!ok) break;
+        ok = fwrite(blk.first, sizeof(float), blk.second, f) == blk.second;
+    }
+    if (fclose(f) != 0) ok = false;
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+    return ok;
+}
+#endif
+
+} // namespace
+
+std::string IrCache::cacheDir()
+{
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) return std::string(xdg) + "/impulseloader";
+    const char* home = getenv("HOME");
+    if (home && *home) return std::string(home) + "/.cache/impulseloader";
+    return std::string();
+}
+
+bool IrCache::makeCacheDir()
+{
+#ifndef _WIN32
+    const std::string dir = cacheDir();
+    return !dir.empty() && makeDirs(dir);
+#else
+    return false;
+#endif
+}
+
+std::string IrCache::diskPath(const std::string& key)
+{
+    const std::string dir = cacheDir();
+    if (dir.empty()) return dir;
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ilc", (unsigned long long)hashKey(key));
+    return dir + "/" + name;
+}
+
+std::shared_ptr<IrData> IrCache::readIr(const std::string& key)
+{
+#ifndef _WIN32
+    const std::string path = diskPath(key);
+    if (path.empty()) return nullptr;
+    std::shared_ptr<MappedFile> m = mapFile(path);
+    if (!m) return nullptr;
+    const CacheHeader* hp = static_cast<const CacheHeader*>(m->data);
+    const size_t dataSize = ((size_t)hp->a * hp->b + 2) * sizeof(float);
+    const CacheHeader* h = checkFile(*m, key, CACHE_IR, dataSize);
+    if (!h || h->a == 0 || h->b == 0) return nullptr;
+    std::shared_ptr<IrData> ir = std::make_shared<IrData>();
+    const float* data = reinterpret_cast<const float*>(
+                        static_cast<const char*>(m->data) + h->dataOffset);
+    ir->length = h->b;
+    ir->sourceLength = std::max(h->c, h->b);
+    ir->channels.resize(h->a);
+    for (uint32_t c = 0; c < h->a; c++) {
+        ir->channels[c].assign(data + c * h->b, data + (c + 1) * h->b);
+    }
+    const float* stats = data + (size_t)h->a * h->b;
+    ir->peak = stats[0];
+    ir->energy = stats[1];
+    return ir;
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const IrPartitions> IrCache::readPartitions(const std::string& key)
+{
+#ifndef _WIN32
+    const std::string path = diskPath(key);
+    if (path.empty()) return nullptr;
+    std::shared_ptr<MappedFile> m = mapFile(path);
+    if (!m) return nullptr;
+    const CacheHeader* hp = static_cast<const CacheHeader*>(m->data);
+    const size_t values = (size_t)hp->b * hp->c;
+    const CacheHeader* h = checkFile(*m, key, CACHE_PARTITIONS, 2 * values * sizeof(float));
+    if (!h || h->b != fft::Transform::ComplexSize(2 * h->a)) return nullptr;
+    const float* re = reinterpret_cast<const float*>(
+                        static_cast<const char*>(m->data) + h->dataOffset);
+    std::shared_ptr<IrPartitions> part = std::make_shared<IrPartitions>();
+    if (!part->initShared(h->a, h->c, re, re + values, m)) return nullptr;
+    return part;
+#else
+    return nullptr;
+#endif
+}
+
+bool IrCache::writeIr(const std::string& key, const IrData& ir)
+{
+#ifndef _WIN32
+    const std::string path = diskPath(key);
+    if (path.empty() || ir.channels.empty()) return false;
+    std::vector<std::pair<const float*, size_t> > blocks;
+    for (const std::vector<float>& c : ir.channels) blocks.push_back({c.data(), ir.length});
+    const float stats[2] = {ir.peak, ir.energy};
+    blocks.push_back({stats, 2});
+    return writeFile(path, key, CACHE_IR, ir.channels.size(), ir.length,
+                     ir.sourceLength, blocks);
+#else
+    return false;
+#endif
+}
+
+bool IrCache::writePartitions(const std::string& key, const IrPartitions& part)
+{
+#ifndef _WIN32
+    const std::string path = diskPath(key);
+    if (path.empty() || part.count() == 0) return false;
+    const size_t values = (size_t)part.complexSize() * part.count();
+    std::vector<std::pair<const float*, size_t> > blocks;
+    blocks.push_back({part.re(0), values});
+    blocks.push_back({part.im(0), values});
+    return writeFile(path, key, CACHE_PARTITIONS, part.blockSize(),
+                     part.complexSize(), part.count(), blocks);
+#else
+    return false;
+#endif
+}
+
+int IrCache::clearDisk()
+{
+    int count = 0;
+#ifndef _WIN32
+    const std::string dir = cacheDir();
+    if (dir.empty()) return 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return 0;
+    struct dirent* e;
+    while ((e = readdir(d)) != nullptr) {
+        const std::string name = e->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".ilc") == 0) {
+            if (unlink((dir + "/" + name).c_str()) == 0) count++;
+        }
+    }
+    closedir(d);
+#endif
+    return count;
+}
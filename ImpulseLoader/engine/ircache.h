@@ -0,0 +1,199 @@
+/*
+ * ircache.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef IRCACHE_H_
+#define IRCACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "partconvolver.h"
+
+
+/****************************************************************
+ ** IrKey - identify a prepared IR: the file (path, modification time
+ *          and size) and everything which change the prepared data
+ */
+
+struct IrKey
+{
+    std::string path;
+    int64_t mtime;
+    int64_t fsize;
+    uint32_t rate;
+    uint32_t shape;
+    uint32_t inputs;
+    uint32_t outputs;
+
+    std::string str() const;
+};
+
+/****************************************************************
+ ** IrStats - the lengths of a prepared IR and the statistics of the file
+ *            it was made from, peak and energy are used to normalise it
+ */
+
+struct IrStats
+{
+    uint32_t length;
+    uint32_t sourceLength;
+    float peak;
+    float energy;
+
+    IrStats() : length(0), sourceLength(0), peak(0.0f), energy(0.0f) {}
+};
+
+/****************************************************************
+ ** IrData - resampled and normalised IR channels, immutable when cached,
+ *           hash is the content hash, set by the cache,
+ *           sourceLength the length before trimming, peak and energy
+ *           the statistics of the file, the normalisation mode is
+ *           applied later as a gain computed from them
+ */
+
+struct IrData
+{
+    std::vector<std::vector<float> > channels;
+    uint32_t length;
+    uint32_t sourceLength;
+    float peak;
+    float energy;
+    uint64_t hash;
+
+    size_t bytes() const;
+    bool sameContent(const IrData& other) const;
+    IrData() : length(0), sourceLength(0), peak(0.0f), energy(0.0f), hash(0) {}
+};
+
+/****************************************************************
+ ** IrCache - process wide cache for prepared IR data and the
+ *            partition spectra build from it, bounded by a LRU
+ *            memory budget. Used from the worker threads only,
+ *            entries stay valid as long as a convolver hold them.
+ *            Backed by a on-disk cache in $XDG_CACHE_HOME/impulseloader/,
+ *            the partition spectra are memory mapped from there.
+ *            IR data is deduplicated by content and the partition spectra
+ *            are keyed by the IR content, so all instances in the process
+ *            using the same IR share them, also after they left the LRU.
+ */
+
+class IrCache
+{
+public:
+    static IrCache& instance();
+
+    // false when the file couldn't be found
+    static bool makeKey(const std::string& path, uint32_t rate, uint32_t shape,
+                        uint32_t inputs, uint32_t outputs, IrKey* key);
+
+    // load the channels into new[] allocated buffers, released by the cache,
+    // and tell the lengths and the statistics of the file
+    typedef std::function<bool(std::vector<float*>* buffer, IrStats* stats)> IrLoader;
+
+    // find the prepared IR or load it, concurrent loads of the same
+    // key are coalesced, the later callers wait for the first one
+    std::shared_ptr<const IrData> loadIr(const IrKey& key, const IrLoader& load);
+    // find or build the partition spectra for a channel of a cached IR,
+    // concurrent builds are coalesced as well. lead zero samples are
+    // placed before the samples from offset on (a pre-delay)
+    std::shared_ptr<const IrPartitions> loadPartitions(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead = 0);
+
+    std::shared_ptr<const IrData> findIr(const IrKey& key);
+    std::shared_ptr<const IrData> insertIr(const IrKey& key,
+                        const std::vector<float*>& buffer, const IrStats& stats);
+
+    std::shared_ptr<const IrPartitions> findPartitions(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead = 0);
+    std::shared_ptr<const IrPartitions> insertPartitions(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead, std::shared_ptr<const IrPartitions> part);
+
+    void setBudget(size_t bytes);
+    size_t budget();
+    size_t used();
+    void clear();
+
+    // the on-disk cache, disabled by IMPULSELOADER_NO_DISK_CACHE=1
+    void setDiskCache(bool enable);
+    bool diskCache();
+    static std::string cacheDir();
+    static bool makeCacheDir();
+    // the FFT implementation the spectra are made with
+    static const char* fftTag();
+    // remove all files from the on-disk cache, return the count
+    static int clearDisk();
+
+private:
+    struct Entry {
+        std::shared_ptr<const IrData> ir;
+        std::shared_ptr<const IrPartitions> part;
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+
+    // data handed out, found again as long as someone hold it
+    struct Live {
+        std::weak_ptr<const IrData> ir;
+        std::weak_ptr<const IrPartitions> part;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    // most recently used first
+    std::list<std::string> lru;
+    std::unordered_map<std::string, Live> live;
+    std::unordered_map<uint64_t, std::weak_ptr<const IrData> > contents;
+    // keys currently loaded by a thread
+    std::unordered_set<std::string> loading;
+    std::condition_variable loaded;
+    size_t budgetBytes;
+    size_t usedBytes;
+    bool useDisk;
+
+    static std::string partitionKey(const IrData& ir, uint32_t channel,
+                        uint32_t blockSize, uint32_t offset, uint32_t length,
+                        uint32_t lead);
+    Entry* find(const std::string& key);
+    void insert(const std::string& key, Entry entry);
+    void evict(const std::string& keep);
+    void pruneLive();
+    std::shared_ptr<const IrData> lookupIr(const std::string& key);
+    std::shared_ptr<const IrPartitions> lookupPartitions(const std::string& key,
+                        uint32_t blockSize);
+    std::shared_ptr<const IrData> share(std::shared_ptr<IrData> ir);
+    void waitLoading(std::unique_lock<std::mutex>& lock, const std::string& key);
+    void doneLoading(const std::string& key);
+
+    static std::string diskPath(const std::string& key);
+    static std::shared_ptr<IrData> readIr(const std::string& key);
+    static std::shared_ptr<const IrPartitions> readPartitions(const std::string& key);
+    static bool writeIr(const std::string& key, const IrData& ir);
+    static bool writePartitions(const std::string& key, const IrPartitions& part);
+
+    IrCache();
+    ~IrCache() {}
+    IrCache(const IrCache&) = delete;
+    IrCache& operator=(const IrCache&) = delete;
+};
+
+#endif  // IRCACHE_H_
@@ -0,0 +1,308 @@
+/*
+ * irreader.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "irreader.h"
+#include "fftconvolver.h"
+#include "gx_resampler.h"
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+
+/****************************************************************
+ ** IrReader
+ */
+
+std::shared_ptr<const IrData> IrReader::loadCached(const std::string& fname,
+                    uint32_t rate, uint32_t shape,
+                    uint32_t inputs, uint32_t outputs)
+{
+    IrKey key;
+    if (!IrCache::makeKey(fname, rate, shape, inputs, outputs, &key)) {
+        fprintf(stderr, "Unable to open %s\n", fname.c_str() );
+        return nullptr;
+    }
+    return IrCache::instance().loadIr(key,
+        [&](std::vector<float*>* buffer, IrStats* stats) {
+            return load(fname, rate, shape, inputs, outputs, buffer, stats);
+        });
+}
+
+double IrReader::normGain(float peak, double energy, uint32_t channels, uint32_t norm)
+{
+    if (peak <= 0.0f || energy <= 0.0 || channels == 0) return 1.0;
+    const double s = 0.8 / peak;
+    const double e = s * s * energy / channels;
+    return s * (norm ? 1.0 : 1.5) / e;
+}
+
+// the IR data is stored normalised, so this is the gain from there
+float IrReader::normalisation(const IrData& ir, uint32_t norm)
+{
+    const uint32_t chan = ir.channels.size();
+    return static_cast<float>(normGain(ir.peak, ir.energy, chan, norm) /
+                              normGain(ir.peak, ir.energy, chan, 1));
+}
+
+uint32_t IrReader::useChannels(uint32_t chan, uint32_t inputs, uint32_t outputs)
+{
+    if (outputs < 2) return 1;
+    return (inputs > 1 && chan >= 4) ? 4 : std::min(chan, 2u);
+}
+
+// peak and energy of the samples written to the IR buffers
+static inline void collect(const float* buf, uint32_t n, float* peak, double* energy)
+{
+    float p = *peak;
+    double e = 0.0;
+    for (uint32_t i = 0; i < n; i++) {
+        p = std::max(p, std::abs(buf[i]));
+        e += static_cast<double>(buf[i]) * buf[i];
+    }
+    *peak = p;
+    *energy += e;
+}
+
+// the onset is searched over all channels, so the channels stay aligned,
+// a short pre roll before it is faded in. The tail is cut after the last
+// window above the noise floor in any channel and faded out over 5 ms.
+uint32_t IrReader::trimIr(std::vector<float*>* buffer, uint32_t length,
+                          float peak, uint32_t rate)
+{
+    if (peak <= 0.0f || length <= tailWindow) return length;
+
+    const float on = peak * onsetThreshold;
+    uint32_t onset = length;
+    for (float* b : *buffer) {
+        uint32_t i = 0;
+        while (i < onset && std::abs(b[i]) <= on) i++;
+        onset = i;
+    }
+    const uint32_t preRoll = std::max(1u, rate / 2000);
+    const uint32_t start = onset > preRoll ? onset - preRoll : 0;
+
+    const double floor = static_cast<double>(peak) * tailThreshold;
+    uint32_t end = onset + 1;
+    for (float* b : *buffer) {
+        uint32_t e = length;
+        while (e > end) {
+            const uint32_t from = e > end + tailWindow ? e - tailWindow : end;
+            double energy = 0.0;
+            for (uint32_t i = from; i < e; i++) energy += static_cast<double>(b[i]) * b[i];
+            if (energy > floor * floor * (e - from)) break;
+            e = from;
+        }
+        end = std::max(end, e);
+    }
+    if (start == 0 && end == length) return length;
+
+    const uint32_t len = end - start;
+    const uint32_t fadeIn = onset - start;
+    const uint32_t fadeOut = end < length ? std::min(rate / 200, len / 4) : 0;
+    const float pi = 3.14159265358979f;
+    for (float* b : *buffer) {
+        for (uint32_t i = 0; i < fadeIn; i++)
+            b[start + i] *= 0.5f * (1.0f - std::cos(pi * i / fadeIn));
+        for (uint32_t i = 0; i < fadeOut; i++)
+            b[end - fadeOut + i] *= 0.5f * (1.0f + std::cos(pi * (i + 1) / fadeOut));
+        if (start) memmove(b, b + start, len * sizeof(float));
+    }
+    return len;
+}
+
+// minimum phase by the real cepstrum: the cepstrum of the log magnitude
+// is folded to the causal part, the exponential of it's spectrum is the
+// minimum phase spectrum. The magnitude response, so the tone and the
+// energy, stay the same, but the energy is packed to the start.
+uint32_t IrReader::minimumPhase(std::vector<float*>* buffer, uint32_t length,
+                                float* peak, uint32_t rate)
+{
+    if (length > maxPhaseFrames) {
+        fprintf(stderr, "IR too long (%u) for minimum phase, skipped\n", length);
+        return length;
+    }
+    // oversized to keep the time aliasing of the cepstrum low
+    uint32_t size = 64;
+    while (size < 4 * length) size *= 2;
+    const uint32_t csize = fft::Transform::ComplexSize(size);
+    fft::Transform fft;
+    fft.init(size);
+    std::vector<float> buf(size);
+    std::vector<float> re(csize);
+    std::vector<float> im(csize);
+
+    uint32_t end = 1;
+    for (float* b : *buffer) {
+        memcpy(buf.data(), b, length * sizeof(float));
+        memset(buf.data() + length, 0, (size - length) * sizeof(float));
+        fft.fft(buf.data(), re.data(), im.data());
+        float mx = 0.0f;
+        for (uint32_t k = 0; k < csize; k++) {
+            re[k] = std::sqrt(re[k] * re[k] + im[k] * im[k]);
+            mx = std::max(mx, re[k]);
+        }
+        if (mx <= 0.0f) continue;
+        // the log magnitude, floored at -140 dB
+        const float floor = mx * 1e-7f;
+        for (uint32_t k = 0; k < csize; k++) {
+            re[k] = std::log(std::max(re[k], floor));
+            im[k] = 0.0f;
+        }
+        fft.ifft(buf.data(), re.data(), im.data());
+        for (uint32_t i = 1; i < size / 2; i++) buf[i] *= 2.0f;
+        memset(buf.data() + size / 2 + 1, 0, (size / 2 - 1) * sizeof(float));
+        fft.fft(buf.data(), re.data(), im.data());
+        for (uint32_t k = 0; k < csize; k++) {
+            const float m = std::exp(re[k]);
+            const float ph = im[k];
+            re[k] = m * std::cos(ph);
+            im[k] = m * std::sin(ph);
+        }
+        fft.ifft(buf.data(), re.data(), im.data());
+        memcpy(b, buf.data(), length * sizeof(float));
+
+        // cut where the remaining energy fall below the threshold
+        double total = 0.0;
+        for (uint32_t i = 0; i < length; i++) total += static_cast<double>(b[i]) * b[i];
+        const double limit = total * phaseThreshold;
+        double tail = 0.0;
+        uint32_t e = length;
+        while (e > end) {
+            const double v = static_cast<double>(b[e - 1]) * b[e - 1];
+            if (tail + v >= limit) break;
+            tail += v;
+            e--;
+        }
+        end = std::max(end, e);
+    }
+
+    const uint32_t fadeOut = end < length ? std::min(rate / 200, end / 4) : 0;
+    const float pi = 3.14159265358979f;
+    float p = 0.0f;
+    for (float* b : *buffer) {
+        for (uint32_t i = 0; i < fadeOut; i++)
+            b[end - fadeOut + i] *= 0.5f * (1.0f + std::cos(pi * (i + 1) / fadeOut));
+        for (uint32_t i = 0; i < end; i++) p = std::max(p, std::abs(b[i]));
+    }
+    *peak = p;
+    return end;
+}
+
+bool IrReader::load(const std::string& fname, uint32_t rate,
+                    uint32_t shape, uint32_t inputs, uint32_t outputs,
+                    std::vector<float*>* buffer, IrStats* stats)
+{
+    buffer->clear();
+    Audiofile audio;
+    if (audio.open_read(fname)) {
+        fprintf(stderr, "Unable to open %s\n", fname.c_str() );
+        return false;
+    }
+    uint32_t frames = audio.size();
+    if (frames > maxFrames) {
+        fprintf(stderr, "too many samples (%u), truncated to %u\n", frames, maxFrames);
+        frames = maxFrames;
+    }
+    const uint32_t chan = audio.chan();
+    if (frames * chan == 0) {
+        fprintf(stderr, "No samples found\n");
+        return false;
+    }
+    const uint32_t use = useChannels(chan, inputs, outputs);
+    const uint32_t srcRate = audio.rate();
+    const bool resample = srcRate != rate;
+
+    // the pooled work buffers, kept for the next load on this thread
+    thread_local std::vector<float> chunk;
+    thread_local std::vector<float> split;
+    chunk.resize(chunkFrames * chan);
+
+    // one streaming resampler per channel, writing straight into the IR buffers
+    std::unique_ptr<gx_resample::StreamingResampler[]> resamp;
+    uint32_t len = frames;
+    uint32_t alloc = frames;
+    if (resample) {
+        resamp.reset(new gx_resample::StreamingResampler[use]);
+        for (uint32_t c = 0; c < use; c++) {
+            if (!resamp[c].setup(srcRate, rate, 1)) {
+                fprintf(stderr, "Unable to resample from %u to %u\n", srcRate, rate);
+                return false;
+            }
+        }
+        len = static_cast<uint32_t>((static_cast<uint64_t>(frames) * rate + srcRate - 1) / srcRate);
+        alloc = len + std::max(resamp[0].get_max_out_size(chunkFrames),
+                               resamp[0].get_max_flush_size());
+        split.resize(std::max(static_cast<uint32_t>(alloc - len), chunkFrames));
+    }
+    for (uint32_t c = 0; c < use; c++) buffer->push_back(new float[alloc]);
+
+    float peak = 0.0f;
+    double energy = 0.0;
+    uint32_t pos[4] = {0, 0, 0, 0};
+    uint32_t done = 0;
+    while (done < frames) {
+        const uint32_t n = std::min(chunkFrames, frames - done);
+        if (audio.read(chunk.data(), n) != static_cast<int>(n)) {
+            fprintf(stderr, "Error reading file\n");
+            for (float* b : *buffer) delete[] b;
+            buffer->clear();
+            return false;
+        }
+        for (uint32_t c = 0; c < use; c++) {
+            float* dst = resample ? split.data() : (*buffer)[c] + done;
+            const float* src = chunk.data() + c;
+            for (uint32_t i = 0; i < n; i++) dst[i] = src[i * chan];
+            if (resample) {
+                float* out = (*buffer)[c] + pos[c];
+                const uint32_t m = std::min(static_cast<uint32_t>(
+                                   resamp[c].process(n, split.data(), out)), len - pos[c]);
+                collect(out, m, &peak, &energy);
+                pos[c] += m;
+            } else {
+                collect(dst, n, &peak, &energy);
+            }
+        }
+        done += n;
+    }
+    if (resample) {
+        // the resampler tail, only as much as the resampled length
+        for (uint32_t c = 0; c < use; c++) {
+            const uint32_t m = std::min(static_cast<uint32_t>(
+                               resamp[c].flush(split.data())), len - pos[c]);
+            float* out = (*buffer)[c] + pos[c];
+            memcpy(out, split.data(), m * sizeof(float));
+            collect(out, m, &peak, &energy);
+            pos[c] += m;
+            if (pos[c] < len) memset((*buffer)[c] + pos[c], 0, (len - pos[c]) * sizeof(float));
+        }
+    }
+    audio.close();
+
+    // the minimum phase IR keep the energy and the trimmed samples are
+    // below the noise floor, so peak and energy collected above are still
+    // good for the gain and the level stay the same
+    stats->sourceLength = len;
+    float shapePeak = peak;
+    if (shape & IR_MINPHASE) len = minimumPhase(buffer, len, &shapePeak, rate);
+    if (shape & IR_TRIM) len = trimIr(buffer, len, shapePeak, rate);
+
+    // normalised in a single pass, the other mode is applied as a gain
+    // by the engine. All channels use the same factor to keep the stereo image.
+    const float g = static_cast<float>(normGain(peak, energy, use, 1));
+    if (g != 1.0f) {
+        for (float* b : *buffer) {
+            for (uint32_t i = 0; i < len; i++) b[i] *= g;
+        }
+    }
+    stats->length = len;
+    stats->peak = peak;
+    stats->energy = static_cast<float>(energy);
+    return true;
+}
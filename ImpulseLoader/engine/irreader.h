@@ -0,0 +1,92 @@
+/*
+ * irreader.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef IRREADER_H_
+#define IRREADER_H_
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "ircache.h"
+
+
+// how the IR is shaped on load, bit flags
+enum IrShape {
+    IR_TRIM = 1,
+    IR_MINPHASE = 2
+};
+
+/****************************************************************
+ ** IrReader - the IR file load pipeline used by all convolvers:
+ *             read the file in chunks, pick the channels while reading,
+ *             stream them through the resampler and collect peak and
+ *             energy on the way, so the file is touched only once.
+ *             Optional the IR is converted to minimum phase and the
+ *             leading silence and the tail below the noise floor are cut.
+ *             Work buffers are pooled per thread.
+ */
+
+class IrReader
+{
+public:
+    // the prepared IR from the cache, loaded on a miss, nullptr on error
+    static std::shared_ptr<const IrData> loadCached(const std::string& fname,
+                        uint32_t rate, uint32_t shape,
+                        uint32_t inputs, uint32_t outputs);
+
+    // read, resample, shape and normalise the channels used by the layout,
+    // the buffers are new[] allocated and owned by the caller.
+    // The IR is normalised for the norm mode, stats tell the lengths and
+    // the peak and energy of the file
+    static bool load(const std::string& fname, uint32_t rate,
+                     uint32_t shape, uint32_t inputs, uint32_t outputs,
+                     std::vector<float*>* buffer, IrStats* stats);
+
+    // the gain to apply to a loaded IR for the normalisation mode,
+    // computed from the statistics kept with it
+    static float normalisation(const IrData& ir, uint32_t norm);
+
+    // IR channels used for a file with chan channels:
+    // mono 1, stereo 2, true stereo 4
+    static uint32_t useChannels(uint32_t chan, uint32_t inputs, uint32_t outputs);
+
+private:
+    static constexpr uint32_t chunkFrames = 8192;
+    // arbitrary size limit
+    static constexpr uint32_t maxFrames = 2000000;
+    // the onset is the first sample above -60 dB, the tail end
+    // the last window with a RMS above -90 dB, both relative to the peak
+    static constexpr float onsetThreshold = 1e-3f;
+    static constexpr float tailThreshold = 3.1623e-5f;
+    static constexpr uint32_t tailWindow = 256;
+
+    // the minimum phase IR is cut where the remaining energy
+    // fall below -70 dB, longer IRs (rooms) are left alone
+    static constexpr double phaseThreshold = 1e-7;
+    static constexpr uint32_t maxPhaseFrames = 131072;
+
+    // the gain for the file statistics: scale to a peak of 0.8 and then
+    // by 1.5 (1.0 with norm) divided by the energy per channel
+    static double normGain(float peak, double energy, uint32_t channels, uint32_t norm);
+
+    // remove the leading silence and the tail below the noise floor
+    // from all channels, return the new length
+    static uint32_t trimIr(std::vector<float*>* buffer, uint32_t length,
+                           float peak, uint32_t rate);
+    // convert all channels to minimum phase and truncate them,
+    // return the new length, peak is set to the new peak
+    static uint32_t minimumPhase(std::vector<float*>* buffer, uint32_t length,
+                                 float* peak, uint32_t rate);
+};
+
+#endif  // IRREADER_H_
@@ -0,0 +1,254 @@
+/*
+ * partconvolver.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "partconvolver.h"
+#include "simd.h"
+#include <string.h>
+#include <algorithm>
+
+
+/****************************************************************
+ ** IrPartitions
+ */
+
+bool IrPartitions::init(uint32_t blockSize, const float* ir, uint32_t irLen, uint32_t lead)
+{
+    _re.clear();
+    _im.clear();
+    _holder.reset();
+    _reData = _imData = nullptr;
+    _count = 0;
+    if (blockSize == 0 || !ir || irLen == 0) return false;
+    // block size must be a power of 2
+    if ((blockSize & (blockSize - 1)) != 0) return false;
+
+    _blockSize = blockSize;
+    const uint32_t segSize = 2 * _blockSize;
+    _complexSize = fft::Transform::ComplexSize(segSize);
+    const uint32_t total = irLen + lead;
+    _count = (total + _blockSize - 1) / _blockSize;
+    _re.resize(_count * _complexSize, 0.0f);
+    _im.resize(_count * _complexSize, 0.0f);
+
+    fft::Transform fft;
+    fft.init(segSize);
+    std::vector<float> buffer(segSize, 0.0f);
+    for (uint32_t i = 0; i < _count; i++) {
+        // the position in the IR, shifted by the leading zeros
+        const uint32_t start = i * _blockSize;
+        const uint32_t pad = start < lead ? lead - start : 0;
+        const uint32_t from = start + pad - lead;
+        const uint32_t size = std::min(total - start, _blockSize) - pad;
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        memcpy(buffer.data() + pad, ir + from, size * sizeof(float));
+        fft.fft(buffer.data(), &_re[i * _complexSize], &_im[i * _complexSize]);
+    }
+    _reData = _re.data();
+    _imData = _im.data();
+    return true;
+}
+
+bool IrPartitions::initShared(uint32_t blockSize, uint32_t count, const float* re,
+                              const float* im, std::shared_ptr<const void> holder)
+{
+    _re.clear();
+    _im.clear();
+    _holder.reset();
+    _reData = _imData = nullptr;
+    _count = 0;
+    if (blockSize == 0 || count == 0 || !re || !im) return false;
+    if ((blockSize & (blockSize - 1)) != 0) return false;
+
+    _blockSize = blockSize;
+    _complexSize = fft::Transform::ComplexSize(2 * _blockSize);
+    _count = count;
+    _reData = re;
+    _imData = im;
+    _holder = holder;
+    return true;
+}
+
+/****************************************************************
+ ** PartitionConvolver
+ */
+
+bool PartitionConvolver::init(std::shared_ptr<const IrPartitions> ir, ScratchArena* arena)
+{
+    std::vector<ConvolutionPath> paths;
+    paths.push_back({0, 0, ir});
+    return init(paths, 1, 1, arena);
+}
+
+bool PartitionConvolver::init(const std::vector<ConvolutionPath>& paths,
+                              uint32_t inputs, uint32_t outputs, ScratchArena* arena,
+                              uint32_t skip)
+{
+    reset();
+    if (paths.empty() || inputs == 0 || outputs == 0 || !arena) return false;
+    for (const ConvolutionPath& p : paths) {
+        if (!p.ir || p.ir->count() == 0) return false;
+        if (p.input >= inputs || p.output >= outputs) return false;
+        if (p.ir->blockSize() != paths[0].ir->blockSize()) return false;
+        _segCount = std::max(_segCount, p.ir->count());
+    }
+    // the delay line hold the skipped blocks as well
+    _skip = skip;
+    _segCount += _skip;
+
+    _paths = paths;
+    _blockSize = paths[0].ir->blockSize();
+    _complexSize = paths[0].ir->complexSize();
+    _fft.init(2 * _blockSize);
+    _inputs.resize(inputs);
+    for (InputLine& in : _inputs) {
+        in.segRe = arena->alloc(_segCount * _complexSize);
+        in.segIm = arena->alloc(_segCount * _complexSize);
+        in.buffer = arena->alloc(_blockSize);
+        if (!in.segRe || !in.segIm || !in.buffer) {
+            reset();
+            return false;
+        }
+    }
+    _outputs.resize(outputs);
+    for (OutputLine& out : _outputs) {
+        out.preRe = arena->alloc(_complexSize);
+        out.preIm = arena->alloc(_complexSize);
+        out.convRe = arena->alloc(_complexSize);
+        out.convIm = arena->alloc(_complexSize);
+        out.overlap = arena->alloc(_blockSize);
+        if (!out.preRe || !out.preIm || !out.convRe || !out.convIm || !out.overlap) {
+            reset();
+            return false;
+        }
+    }
+    _fftBuffer = arena->alloc(2 * _blockSize);
+    if (!_fftBuffer) {
+        reset();
+        return false;
+    }
+    _current = 0;
+    _inputFill = 0;
+    return true;
+}
+
+void PartitionConvolver::clear()
+{
+    for (InputLine& in : _inputs) {
+        memset(in.segRe, 0, _segCount * _complexSize * sizeof(float));
+        memset(in.segIm, 0, _segCount * _complexSize * sizeof(float));
+        memset(in.buffer, 0, _blockSize * sizeof(float));
+    }
+    for (OutputLine& out : _outputs)
+        memset(out.overlap, 0, _blockSize * sizeof(float));
+    _current = 0;
+    _inputFill = 0;
+}
+
+void PartitionConvolver::reset()
+{
+    _paths.clear();
+    _inputs.clear();
+    _outputs.clear();
+    _blockSize = 0;
+    _complexSize = 0;
+    _segCount = 0;
+    _skip = 0;
+    _current = 0;
+    _inputFill = 0;
+    _fftBuffer = nullptr;
+}
+
+void PartitionConvolver::process(const float* input, float* output, uint32_t len)
+{
+    process(&input, &output, len);
+}
+
+void PartitionConvolver::process(const float* const* inputs, float* const* outputs, uint32_t len)
+{
+    if (_segCount == 0) {
+        for (uint32_t o = 0; o < _outputs.size(); o++)
+            memset(outputs[o], 0, len * sizeof(float));
+        return;
+    }
+
+    uint32_t processed = 0;
+    while (processed < len) {
+        const bool inputWasEmpty = (_inputFill == 0);
+        const uint32_t processing = std::min(len - processed, _blockSize - _inputFill);
+        const uint32_t inputPos = _inputFill;
+        const bool blockComplete = (_inputFill + processing == _blockSize);
+
+        // forward FFT of the (partial) input blocks, once per input,
+        // with skipped partitions the current block is only needed when complete
+        for (uint32_t i = 0; i < _inputs.size(); i++) {
+            InputLine& in = _inputs[i];
+            memcpy(&in.buffer[inputPos], inputs[i] + processed, processing * sizeof(float));
+            if (_skip && !blockComplete) continue;
+            memcpy(_fftBuffer, in.buffer, _blockSize * sizeof(float));
+            memset(&_fftBuffer[_blockSize], 0, _blockSize * sizeof(float));
+            _fft.fft(_fftBuffer, &in.segRe[_current * _complexSize],
+                                        &in.segIm[_current * _complexSize]);
+        }
+
+        // the older segments only change once per block
+        if (inputWasEmpty) {
+            for (OutputLine& out : _outputs) {
+                memset(out.preRe, 0, _complexSize * sizeof(float));
+                memset(out.preIm, 0, _complexSize * sizeof(float));
+            }
+            for (const ConvolutionPath& p : _paths) {
+                const InputLine& in = _inputs[p.input];
+                OutputLine& out = _outputs[p.output];
+                for (uint32_t i = _skip ? 0 : 1; i < p.ir->count(); i++) {
+                    const uint32_t audio = (_current + i + _skip) % _segCount;
+                    simd::complexMultiplyAccumulate(out.preRe, out.preIm,
+                        p.ir->re(i), p.ir->im(i),
+                        &in.segRe[audio * _complexSize], &in.segIm[audio * _complexSize],
+                        _complexSize);
+                }
+            }
+        }
+        for (OutputLine& out : _outputs) {
+            memcpy(out.convRe, out.preRe, _complexSize * sizeof(float));
+            memcpy(out.convIm, out.preIm, _complexSize * sizeof(float));
+        }
+        for (const ConvolutionPath& p : _paths) {
+            if (_skip) break;
+            const InputLine& in = _inputs[p.input];
+            OutputLine& out = _outputs[p.output];
+            simd::complexMultiplyAccumulate(out.convRe, out.convIm,
+                p.ir->re(0), p.ir->im(0),
+                &in.segRe[_current * _complexSize], &in.segIm[_current * _complexSize],
+                _complexSize);
+        }
+
+        // backward FFT and add the overlap, once per output
+        for (uint32_t o = 0; o < _outputs.size(); o++) {
+            OutputLine& out = _outputs[o];
+            _fft.ifft(_fftBuffer, out.convRe, out.convIm);
+            float* output = outputs[o] + processed;
+            for (uint32_t i = 0; i < processing; i++) {
+                output[i] = _fftBuffer[inputPos + i] + out.overlap[inputPos + i];
+            }
+            if (blockComplete) {
+                memcpy(out.overlap, &_fftBuffer[_blockSize], _blockSize * sizeof(float));
+            }
+        }
+
+        // block complete, step the delay lines
+        _inputFill += processing;
+        if (blockComplete) {
+            for (InputLine& in : _inputs)
+                memset(in.buffer, 0, _blockSize * sizeof(float));
+            _inputFill = 0;
+            _current = (_current > 0) ? (_current - 1) : (_segCount - 1);
+        }
+        processed += processing;
+    }
+}
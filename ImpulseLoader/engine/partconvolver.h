@@ -0,0 +1,137 @@
+/*
+ * partconvolver.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef PARTCONVOLVER_H_
+#define PARTCONVOLVER_H_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "fftbackend.h"
+#include "arena.h"
+
+
+/****************************************************************
+ ** IrPartitions - the frequency domain partitions of a impulse response
+ *                 for a given block size. Immutable after init(),
+ *                 so it could be shared by several convolvers.
+ */
+
+class IrPartitions
+{
+public:
+    // lead zero samples are placed before the IR in the first partition
+    bool init(uint32_t blockSize, const float* ir, uint32_t irLen, uint32_t lead = 0);
+    // use spectra stored elsewhere (a mapped cache file),
+    // holder keep the memory alive as long as the partitions live
+    bool initShared(uint32_t blockSize, uint32_t count, const float* re,
+                    const float* im, std::shared_ptr<const void> holder);
+
+    inline uint32_t blockSize() const { return _blockSize;}
+    inline uint32_t complexSize() const { return _complexSize;}
+    inline uint32_t count() const { return _count;}
+    inline const float* re(uint32_t i) const { return _reData + i * _complexSize;}
+    inline const float* im(uint32_t i) const { return _imData + i * _complexSize;}
+    inline size_t bytes() const { return 2 * _count * _complexSize * sizeof(float);}
+
+    IrPartitions() : _blockSize(0), _complexSize(0), _count(0),
+                     _reData(nullptr), _imData(nullptr) {}
+    ~IrPartitions() {}
+
+private:
+    uint32_t _blockSize;
+    uint32_t _complexSize;
+    uint32_t _count;
+    const float* _reData;
+    const float* _imData;
+    std::vector<float> _re;
+    std::vector<float> _im;
+    std::shared_ptr<const void> _holder;
+};
+
+/****************************************************************
+ ** ConvolutionPath - route one input through a IR into one output.
+ *                    Several paths could share a input, the input
+ *                    spectrum is then computed only once, and paths
+ *                    to the same output are summed before the inverse FFT.
+ */
+
+struct ConvolutionPath
+{
+    uint32_t input;
+    uint32_t output;
+    std::shared_ptr<const IrPartitions> ir;
+};
+
+/****************************************************************
+ ** PartitionConvolver - uniform partitioned zero latency convolver
+ *                       working on a (shared) set of IrPartitions.
+ *                       Only the input delay lines and the overlap
+ *                       is used by the convolver, from a ScratchArena. With skip the
+ *                       partitions are delayed by skip blocks, the
+ *                       zero partitions before them are never computed.
+ */
+
+class PartitionConvolver
+{
+public:
+    // mono, a single path. The buffers are taken from the arena,
+    // they are valid until the owner rewind it.
+    bool init(std::shared_ptr<const IrPartitions> ir, ScratchArena* arena);
+    // multichannel, all paths must use the same block size
+    bool init(const std::vector<ConvolutionPath>& paths, uint32_t inputs, uint32_t outputs,
+              ScratchArena* arena, uint32_t skip = 0);
+    // process len samples, input and output may point to the same buffer
+    void process(const float* input, float* output, uint32_t len);
+    void process(const float* const* inputs, float* const* outputs, uint32_t len);
+    // forget the input history and the overlap, keep the buffers
+    void clear();
+    void reset();
+
+    inline uint32_t blockSize() const { return _blockSize;}
+    inline uint32_t inputs() const { return _inputs.size();}
+    inline uint32_t outputs() const { return _outputs.size();}
+    inline uint32_t skip() const { return _skip;}
+
+    PartitionConvolver() : _blockSize(0), _complexSize(0), _segCount(0),
+                           _skip(0), _current(0), _inputFill(0), _fftBuffer(nullptr) {}
+    ~PartitionConvolver() {}
+
+private:
+    struct InputLine {
+        float* segRe;
+        float* segIm;
+        float* buffer;
+    };
+
+    struct OutputLine {
+        float* preRe;
+        float* preIm;
+        float* convRe;
+        float* convIm;
+        float* overlap;
+    };
+
+    std::vector<ConvolutionPath> _paths;
+    std::vector<InputLine> _inputs;
+    std::vector<OutputLine> _outputs;
+    fft::Transform _fft;
+    uint32_t _blockSize;
+    uint32_t _complexSize;
+    uint32_t _segCount;
+    uint32_t _skip;
+    uint32_t _current;
+    uint32_t _inputFill;
+    float* _fftBuffer;
+};
+
+#endif  // PARTCONVOLVER_H_
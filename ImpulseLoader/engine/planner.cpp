@@ -0,0 +1,403 @@
+/*
+ * planner.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "planner.h"
+#include "ircache.h"
+#include "simd.h"
+#include "threadpool.h"
+#include "fftbackend.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+
+/****************************************************************
+ ** Planner - the calibration
+ */
+
+Planner& Planner::instance()
+{
+    static Planner planner;
+    return planner;
+}
+
+Planner::Planner() : macCost(0.0), firCost(0.0), wakeCost(0.0), ready(false)
+{
+    for (uint32_t i = 0; i <= maxFft; i++) fftCost[i] = 0.0;
+    cores = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::string Planner::calibrationFile()
+{
+    const std::string dir = IrCache::cacheDir();
+    return dir.empty() ? dir : dir + "/planner.cal";
+}
+
+// the costs are measured once per process, or read from the file
+void Planner::setup()
+{
+    if (ready) return;
+    if (!load()) {
+        measure();
+        if (IrCache::instance().diskCache()) save();
+    }
+    ready = true;
+}
+
+void Planner::calibrate()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    measure();
+    ready = true;
+    if (IrCache::instance().diskCache()) save();
+}
+
+static void wakeJob() {}
+
+// a few ms per FFT size, the complex multiply-add over a working set
+// larger then the caches, like the partitions of a long IR
+void Planner::measure()
+{
+    typedef std::chrono::steady_clock Clock;
+    const double minTime = 2e6;
+    for (uint32_t i = minFft; i <= maxFft; i++) {
+        const uint32_t size = 1u << i;
+        const uint32_t csize = fft::Transform::ComplexSize(size);
+        fft::Transform f;
+        f.init(size);
+        std::vector<float> buf(size, 0.0f);
+        std::vector<float> re(csize, 0.0f);
+        std::vector<float> im(csize, 0.0f);
+        for (uint32_t k = 0; k < size; k++) buf[k] = static_cast<float>(k % 17) * 0.01f;
+        uint32_t runs = 0;
+        double elapsed = 0.0;
+        const auto start = Clock::now();
+        while (runs < 4 || elapsed < minTime) {
+            f.fft(buf.data(), re.data(), im.data());
+            f.ifft(buf.data(), re.data(), im.data());
+            runs++;
+            elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+        fftCost[i] = elapsed / runs;
+    }
+
+    const uint32_t bins = 1025;
+    const uint32_t parts = 256;
+    std::vector<float> a(2 * bins * parts, 0.5f);
+    std::vector<float> b(2 * bins * parts, 0.25f);
+    std::vector<float> acc(2 * bins, 0.0f);
+    uint32_t runs = 0;
+    double elapsed = 0.0;
+    const auto start = Clock::now();
+    while (runs < 2 || elapsed < minTime) {
+        for (uint32_t p = 0; p < parts; p++) {
+            const float* pa = a.data() + 2 * bins * p;
+            const float* pb = b.data() + 2 * bins * p;
+            simd::complexMultiplyAccumulate(acc.data(), acc.data() + bins,
+                                            pa, pa + bins, pb, pb + bins, bins);
+        }
+        runs++;
+        elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    macCost = elapsed / (static_cast<double>(runs) * parts * bins);
+
+    // the direct form FIR with a short cab IR
+    {
+        const uint32_t taps = 1024;
+        const uint32_t len = 256;
+        std::vector<float> h(taps, 0.1f);
+        std::vector<float> x(taps - 1 + len, 0.5f);
+        std::vector<float> y(len, 0.0f);
+        uint32_t fruns = 0;
+        double ftime = 0.0;
+        const auto fstart = Clock::now();
+        while (fruns < 4 || ftime < minTime) {
+            simd::fir(y.data(), x.data(), h.data(), taps, len);
+            fruns++;
+            ftime = std::chrono::duration<double, std::nano>(Clock::now() - fstart).count();
+        }
+        firCost = ftime / (static_cast<double>(fruns) * taps * len);
+    }
+
+    // the time the process thread spend to hand a job to the realtime
+    // workers of the pool and to pick it up a bit later, like the convolvers do
+    ThreadPool::instance().acquire();
+    uint32_t done = 0;
+    double wtime = 0.0;
+    {
+        PoolJob pro;
+        pro.set<&wakeJob>();
+        const uint32_t wakes = 32;
+        for (uint32_t i = 0; i < wakes; i++) {
+            const auto t0 = Clock::now();
+            pro.runProcess(ThreadPool::now() + 1000000);
+            const auto t1 = Clock::now();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            const auto t2 = Clock::now();
+            if (pro.processWait()) done++;
+            wtime += std::chrono::duration<double, std::nano>((t1 - t0) + (Clock::now() - t2)).count();
+        }
+        pro.stop();
+    }
+    ThreadPool::instance().release();
+    // a thread which don't come back is expensive
+    wakeCost = done ? wtime / done : 1e6;
+}
+
+// the file is bound to the kernels and the FFT in use
+bool Planner::load()
+{
+    const std::string path = calibrationFile();
+    if (path.empty() || !IrCache::instance().diskCache()) return false;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) return false;
+    char level[32] = {0};
+    char fft[32] = {0};
+    unsigned int version = 0;
+    bool ok = fscanf(f, "ImpulseLoader planner %u %31s %31s", &version, level, fft) == 3 &&
+              version == calibrationVersion && strcmp(level, simd::levelName()) == 0 &&
+              strcmp(fft, IrCache::fftTag()) == 0;
+    for (uint32_t i = minFft; ok && i <= maxFft; i++) {
+        unsigned int n = 0;
+        ok = fscanf(f, " fft %u %lf", &n, &fftCost[i]) == 2 && n == i && fftCost[i] > 0.0;
+    }
+    if (ok) ok = fscanf(f, " mac %lf fir %lf wake %lf", &macCost, &firCost, &wakeCost) == 3 &&
+                 macCost > 0.0 && firCost > 0.0 && wakeCost > 0.0;
+    fclose(f);
+    return ok;
+}
+
+bool Planner::save() const
+{
+    const std::string path = calibrationFile();
+    if (path.empty() || !IrCache::makeCacheDir()) return false;
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "ImpulseLoader planner %u %s %s\n", calibrationVersion,
+            simd::levelName(), IrCache::fftTag());
+    for (uint32_t i = minFft; i <= maxFft; i++) fprintf(f, "fft %u %.1f\n", i, fftCost[i]);
+    fprintf(f, "mac %.4f\nfir %.6f\nwake %.1f\n", macCost, firCost, wakeCost);
+    bool ok = fclose(f) == 0;
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+    return ok;
+}
+
+/****************************************************************
+ ** Planner - the cost model
+ */
+
+// a forward or inverse FFT, larger sizes scale with n log n
+double Planner::fftTime(uint32_t size) const
+{
+    uint32_t i = minFft;
+    while (i < maxFft && (1u << i) < size) i++;
+    const double n = static_cast<double>(1u << i);
+    if (size <= n) return 0.5 * fftCost[i];
+    return 0.5 * fftCost[i] * (size / n) * (std::log2(size) / i);
+}
+
+// the zero latency stage, the input is transformed on each process call
+// and multiplied with the first partition, the others once per block
+void Planner::head(Load* l, uint32_t block, uint32_t parts, uint32_t blockSize,
+                   uint32_t rate, uint32_t ffts, uint32_t paths) const
+{
+    if (!parts) return;
+    const double calls = static_cast<double>(rate) / std::min(blockSize, block);
+    const double part = (block + 1) * macCost * paths;
+    const double f = ffts * fftTime(2 * block);
+    l->mean += calls * (f + part) + static_cast<double>(rate) / block * (parts - 1) * part;
+    const double once = f + parts * part;
+    l->peak += blockSize > block ? once * blockSize / block : once;
+}
+
+// a stage processing only complete blocks, the whole block
+// is computed in the host block which complete it
+void Planner::stage(Load* l, uint32_t block, uint32_t parts, uint32_t blockSize,
+                    uint32_t rate, uint32_t ffts, uint32_t paths, bool background) const
+{
+    if (!parts) return;
+    const double once = ffts * fftTime(2 * block) + parts * (block + 1) * macCost * paths;
+    const double perSecond = static_cast<double>(rate) / block;
+    if (background) {
+        l->bg += perSecond * once;
+        l->mean += perSecond * wakeCost;
+        l->peak += wakeCost;
+    } else {
+        l->mean += perSecond * once;
+        l->peak += blockSize > block ? once * blockSize / block : once;
+    }
+}
+
+// the direct form FIR, each sample cost all taps, on each process call
+void Planner::fir(Load* l, uint32_t taps, uint32_t blockSize, uint32_t rate, uint32_t paths) const
+{
+    const double sample = taps * firCost * paths;
+    l->mean += rate * sample;
+    l->peak += blockSize * sample;
+}
+
+// work in a background thread run parallel when there is a free core
+double Planner::cost(const Load& l) const
+{
+    return l.mean + (cores > 1 ? 0.5 : 1.0) * l.bg;
+}
+
+// the same layout as MultiStageConvolver::init() use, each stage use
+// a 4 times larger block then the one before and start at it's block
+// size, the background stage at twice it's block size. With a FIR head
+// the first stage isn't zero latency and start at it's block size as well,
+// when the FIR cover the whole IR there are no stages at all
+void Planner::stages(const ConvPlan& plan, uint32_t irLen, std::vector<uint32_t>* blocks,
+                     std::vector<uint32_t>* offsets, bool* background)
+{
+    const uint32_t largest = std::max(plan.tail, plan.head);
+    blocks->clear();
+    *background = false;
+    if (plan.fir >= irLen) {
+        offsets->assign(1, irLen);
+        return;
+    }
+    blocks->push_back(plan.head);
+    while (blocks->back() < largest && std::min(blocks->back() * 4, largest) < irLen)
+        blocks->push_back(std::min(blocks->back() * 4, largest));
+
+    const size_t last = blocks->size() - 1;
+    offsets->assign(blocks->size() + 1, 0);
+    for (size_t i = plan.fir ? 0 : 1; i < blocks->size(); i++) (*offsets)[i] = (*blocks)[i];
+    *background = (plan.bgBlock && last > 0 && (*blocks)[last] >= plan.bgBlock &&
+                   2 * (*blocks)[last] < irLen);
+    if (*background) (*offsets)[last] = 2 * (*blocks)[last];
+    (*offsets)[blocks->size()] = irLen;
+}
+
+// the plans which keep the worst host block below half the block time
+// are preferred, from them the one with the lowest mean load is used.
+// When the background tail missed it's deadline, the fallback plan give
+// it a twice as large partition, so it get more time and wake up less
+// often, or don't use a background thread at all
+ConvPlan Planner::plan(uint32_t irLen, uint32_t delay, uint32_t blockSize, uint32_t rate,
+                       uint32_t inputs, uint32_t outputs, uint32_t paths, bool multi,
+                       uint32_t fallback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    setup();
+    const uint32_t bs = blockSize ? blockSize : 256;
+    const uint32_t sr = rate ? rate : 48000;
+    const uint32_t len = std::max(irLen, 1u);
+    const uint32_t length = len > delay ? len - delay : 1;
+    const uint32_t ffts = inputs + outputs;
+    const double budget = 0.5e9 * bs / sr;
+
+    ConvPlan best;
+    bool found = false;
+    bool bestFits = false;
+    double bestPeak = 0.0;
+    auto consider = [&](const ConvPlan& p, const Load& l) {
+        const bool fits = l.peak <= budget;
+        const double c = cost(l);
+        if (!found || (fits && !bestFits) ||
+            (fits == bestFits && (fits ? c < best.cost : l.peak < bestPeak))) {
+            best = p;
+            best.cost = c;
+            bestPeak = l.peak;
+            bestFits = fits;
+            found = true;
+        }
+    };
+    auto parts = [](uint32_t n, uint32_t block) { return (n + block - 1) / block; };
+    const bool foreground = fallback >= ConvPlan::FALLBACK_FOREGROUND;
+
+    if (!multi) {
+        // short IRs in the time domain
+        if (length <= maxDirect) {
+            ConvPlan p;
+            p.engine = ConvPlan::DIRECT;
+            p.fir = length;
+            Load l = {0.0, 0.0, 0.0};
+            fir(&l, length, bs, sr, 1);
+            consider(p, l);
+        }
+        for (uint32_t b = minBlock; b <= 16384 && (b == minBlock || b / 2 < length); b *= 2) {
+            ConvPlan p;
+            p.engine = ConvPlan::SINGLE;
+            p.head = b;
+            Load l = {0.0, 0.0, 0.0};
+            head(&l, b, parts(length, b), bs, sr, 2, 1);
+            consider(p, l);
+        }
+        // the tail convolver start at the tail size with the head block size,
+        // the background part at twice the tail size
+        for (uint32_t h = minBlock; h <= 4096 && !foreground; h *= 2) {
+            for (uint32_t t = 2 * h; t <= 32768 && t < length; t *= 2) {
+                ConvPlan p;
+                p.engine = ConvPlan::DOUBLE;
+                p.head = h;
+                p.tail = t;
+                Load l = {0.0, 0.0, 0.0};
+                head(&l, h, parts(std::min(length, t), h), bs, sr, 2, 1);
+                stage(&l, h, parts(std::min(length - t, t), h), bs, sr, 2, 1, false);
+                if (length > 2 * t) stage(&l, t, parts(length - 2 * t, t), bs, sr, 2, 1, true);
+                consider(p, l);
+            }
+        }
+    }
+
+    std::vector<uint32_t> blocks;
+    std::vector<uint32_t> offsets;
+    for (uint32_t h = minBlock; h <= 8192; h *= 2) {
+        for (uint32_t t = h; t <= maxBlock; t *= 4) {
+            for (uint32_t bg = 0; bg < (foreground ? 1u : 2u); bg++) {
+                // the zero latency head as FFT partitions or as FIR
+                for (uint32_t direct = 0; direct < (h <= maxFirHead ? 2u : 1u); direct++) {
+                    ConvPlan p;
+                    p.engine = ConvPlan::MULTI;
+                    p.head = h;
+                    p.tail = t;
+                    p.bgBlock = bg ? t : 0;
+                    p.fir = direct ? h : 0;
+                    bool background = false;
+                    stages(p, len, &blocks, &offsets, &background);
+                    if (bg && !background) continue;
+                    Load l = {0.0, 0.0, 0.0};
+                    if (direct) {
+                        const uint32_t taps = std::min(h, len);
+                        fir(&l, taps > delay ? taps - delay : 0, bs, sr, paths);
+                    }
+                    for (size_t i = 0; i < blocks.size(); i++) {
+                        if (offsets[i+1] <= delay) continue;
+                        const uint32_t zeros = delay > offsets[i] ? (delay - offsets[i]) % blocks[i] : 0;
+                        const uint32_t n = parts(zeros + offsets[i+1] - std::max(offsets[i], delay), blocks[i]);
+                        if (i == 0 && !direct) head(&l, blocks[i], n, bs, sr, ffts, paths);
+                        else stage(&l, blocks[i], n, bs, sr, ffts, paths,
+                                   background && i == blocks.size() - 1);
+                    }
+                    consider(p, l);
+                }
+            }
+            // the stages don't grow any more
+            if (t >= len) break;
+        }
+    }
+
+    if (fallback == ConvPlan::FALLBACK_TAIL) {
+        if (best.engine == ConvPlan::DOUBLE && best.tail < 32768) {
+            best.tail *= 2;
+        } else if (best.engine == ConvPlan::MULTI && best.bgBlock && best.tail < maxBlock) {
+            best.tail *= 2;
+            best.bgBlock = best.tail;
+        }
+    }
+    return best;
+}
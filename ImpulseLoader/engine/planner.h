@@ -0,0 +1,135 @@
+/*
+ * planner.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef PLANNER_H_
+#define PLANNER_H_
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+#include <vector>
+
+
+/****************************************************************
+ ** ConvPlan - the convolver and the partition layout used for a IR
+ */
+
+struct ConvPlan
+{
+    enum {
+        SINGLE,     // uniform partitions, all in the process thread
+        DOUBLE,     // head and tail, the tail in a background thread
+        MULTI,      // growing stages, the last one may run in background
+        DIRECT      // a direct form FIR, for short IRs
+    };
+
+    // the plans used when the background tail missed it's deadline
+    enum {
+        FALLBACK_NONE,
+        FALLBACK_TAIL,          // the background tail use a larger partition
+        FALLBACK_FOREGROUND,    // all stages run in the process thread
+        FALLBACK_MAX = FALLBACK_FOREGROUND
+    };
+
+    uint32_t engine;
+    // the partition size of the zero latency head
+    uint32_t head;
+    // DOUBLE: the tail partition size, MULTI: the largest stage
+    uint32_t tail;
+    // MULTI: the last stage run in background from this size on, 0 never
+    uint32_t bgBlock;
+    // DIRECT: the IR length, MULTI: the head is a direct form FIR
+    // of the head size in front of the stages, 0 when not
+    uint32_t fir;
+    // the estimated load in ns per second of audio
+    double cost;
+
+    ConvPlan() : engine(SINGLE), head(1024), tail(8192), bgBlock(4096), fir(0), cost(0.0) {}
+};
+
+/****************************************************************
+ ** Planner - choose the convolver and the partition layout with the
+ *            lowest estimated load for the IR length, the host block size,
+ *            the sample rate and the core count. The cost model use the
+ *            time of a FFT and of a complex multiply-add, measured once on
+ *            the running CPU and kept in the cache directory, like FFTW wisdom.
+ */
+
+class Planner
+{
+public:
+    static Planner& instance();
+
+    // irLen is the used IR length plus the pre-delay, paths the count of
+    // IR channels convolved. With multi only the multi stage convolver
+    // is planned, as only this one handle the stereo modes and the delay.
+    // fallback is one of the ConvPlan::FALLBACK_ values
+    ConvPlan plan(uint32_t irLen, uint32_t delay, uint32_t blockSize, uint32_t rate,
+                  uint32_t inputs, uint32_t outputs, uint32_t paths, bool multi,
+                  uint32_t fallback = ConvPlan::FALLBACK_NONE);
+
+    // the stages of the multi stage convolver for a plan: the block sizes,
+    // the IR range they cover and if the last one run in background
+    static void stages(const ConvPlan& plan, uint32_t irLen, std::vector<uint32_t>* blocks,
+                       std::vector<uint32_t>* offsets, bool* background);
+
+    // measure the costs again and store them
+    void calibrate();
+    static std::string calibrationFile();
+
+private:
+    static constexpr uint32_t minBlock = 64;
+    static constexpr uint32_t maxBlock = 65536;
+    // FFT sizes measured, 1 << minFft .. 1 << maxFft
+    static constexpr uint32_t minFft = 7;
+    static constexpr uint32_t maxFft = 17;
+    // the longest IR for the direct form FIR, and for it as head of the stages
+    static constexpr uint32_t maxDirect = 4096;
+    static constexpr uint32_t maxFirHead = 1024;
+    static constexpr uint32_t calibrationVersion = 3;
+
+    // ns for a forward plus a inverse FFT of size 1 << i
+    double fftCost[maxFft + 1];
+    // ns for a complex multiply-add of one bin
+    double macCost;
+    // ns for one tap of the direct form FIR per sample
+    double firCost;
+    // ns to hand a job to a background thread and wait for it
+    double wakeCost;
+    uint32_t cores;
+    bool ready;
+    std::mutex mutex;
+
+    struct Load {
+        double mean;    // ns per second in the process thread
+        double peak;    // ns for the worst host block in the process thread
+        double bg;      // ns per second in background threads
+    };
+
+    void setup();
+    void measure();
+    bool load();
+    bool save() const;
+    double fftTime(uint32_t size) const;
+    void head(Load* l, uint32_t block, uint32_t parts, uint32_t blockSize, uint32_t rate,
+              uint32_t ffts, uint32_t paths) const;
+    void stage(Load* l, uint32_t block, uint32_t parts, uint32_t blockSize, uint32_t rate,
+               uint32_t ffts, uint32_t paths, bool background) const;
+    void fir(Load* l, uint32_t taps, uint32_t blockSize, uint32_t rate, uint32_t paths) const;
+    double cost(const Load& l) const;
+
+    Planner();
+    ~Planner() {}
+    Planner(const Planner&) = delete;
+    Planner& operator=(const Planner&) = delete;
+};
+
+#endif  // PLANNER_H_
@@ -0,0 +1,341 @@
+/*
+ * simd.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "simd.h"
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SIMD_X86 1
+#endif
+
+#if defined(SIMD_X86)
+#define SIMD_AVX2   __attribute__((target("avx2,fma")))
+#define SIMD_AVX512 __attribute__((target("avx512f,avx512dq,avx2,fma")))
+#endif
+
+#define SIMD_INLINE inline __attribute__((always_inline))
+
+namespace simd {
+
+/****************************************************************
+ ** kernel bodies, inlined and vectorized by the compiler
+ *  into the ISA specific wrappers below
+ */
+
+template <bool FMA>
+static SIMD_INLINE void cmacImpl(float* __restrict re, float* __restrict im,
+                const float* __restrict reA, const float* __restrict imA,
+                const float* __restrict reB, const float* __restrict imB, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        if (FMA) {
+            re[i] = std::fma(reA[i], reB[i], std::fma(-imA[i], imB[i], re[i]));
+            im[i] = std::fma(reA[i], imB[i], std::fma(imA[i], reB[i], im[i]));
+        } else {
+            re[i] += reA[i] * reB[i] - imA[i] * imB[i];
+            im[i] += reA[i] * imB[i] + imA[i] * reB[i];
+        }
+    }
+}
+
+static SIMD_INLINE void scaleImpl(float* __restrict output, const float* __restrict input,
+                float gain, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        output[i] = input[i] * gain;
+    }
+}
+
+static SIMD_INLINE void rampImpl(float* output, const float* input,
+                float gain, float step, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        output[i] = input[i] * (gain + step * static_cast<float>(i));
+    }
+}
+
+static SIMD_INLINE void fadeImpl(float* output, const float* a, const float* b,
+                float fade, float step, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        output[i] = a[i] + (fade + step * static_cast<float>(i)) * (b[i] - a[i]);
+    }
+}
+
+// W outputs are kept in registers while the taps run through, the taps
+// are blocked so the taps and the input window stay in the L1 cache
+static constexpr uint32_t FIRTAPS = 1024;
+
+template <uint32_t W>
+static SIMD_INLINE uint32_t firBlock(float* __restrict output, const float* __restrict input,
+                const float* __restrict taps, uint32_t count, uint32_t len)
+{
+    uint32_t i = 0;
+    for (; i + W <= len; i += W) {
+        float acc[W];
+        for (uint32_t j = 0; j < W; j++) acc[j] = output[i + j];
+        for (uint32_t k = 0; k < count; k++) {
+            const float h = taps[k];
+            const float* x = input + i + k;
+            for (uint32_t j = 0; j < W; j++) acc[j] += h * x[j];
+        }
+        for (uint32_t j = 0; j < W; j++) output[i + j] = acc[j];
+    }
+    return i;
+}
+
+template <uint32_t W>
+static SIMD_INLINE void firImpl(float* output, const float* input, const float* taps,
+                uint32_t count, uint32_t len)
+{
+    for (uint32_t k = 0; k < count; k += FIRTAPS) {
+        const uint32_t n = std::min(FIRTAPS, count - k);
+        uint32_t i = firBlock<W>(output, input + k, taps + k, n, len);
+        i += firBlock<4>(output + i, input + k + i, taps + k, n, len - i);
+        firBlock<1>(output + i, input + k + i, taps + k, n, len - i);
+    }
+}
+
+// the PCM conversions load through memcpy, the samples in a
+// file mapping aren't aligned, the compiler turn it in plain loads
+static SIMD_INLINE void s16Impl(float* __restrict output, const uint8_t* __restrict input,
+                uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        int16_t v;
+        memcpy(&v, input + 2 * i, 2);
+        output[i] = static_cast<float>(v) * (1.0f / 32768.0f);
+    }
+}
+
+static SIMD_INLINE void s24Impl(float* __restrict output, const uint8_t* __restrict input,
+                uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        const uint8_t* p = input + 3 * i;
+        const int32_t v = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) |
+                          (static_cast<uint32_t>(p[1]) << 16) |
+                          (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+        output[i] = static_cast<float>(v) * (1.0f / 8388608.0f);
+    }
+}
+
+static SIMD_INLINE void s32Impl(float* __restrict output, const uint8_t* __restrict input,
+                uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        int32_t v;
+        memcpy(&v, input + 4 * i, 4);
+        output[i] = static_cast<float>(v) * (1.0f / 2147483648.0f);
+    }
+}
+
+/****************************************************************
+ ** the ISA specific kernels
+ */
+
+static void cmacGeneric(float* re, float* im, const float* reA, const float* imA,
+                const float* reB, const float* imB, uint32_t len) {
+    cmacImpl<false>(re, im, reA, imA, reB, imB, len);
+}
+
+static void scaleGeneric(float* output, const float* input, float gain, uint32_t len) {
+    scaleImpl(output, input, gain, len);
+}
+
+static void rampGeneric(float* output, const float* input, float gain, float step, uint32_t len) {
+    rampImpl(output, input, gain, step, len);
+}
+
+static void fadeGeneric(float* output, const float* a, const float* b,
+                float fade, float step, uint32_t len) {
+    fadeImpl(output, a, b, fade, step, len);
+}
+
+static void firGeneric(float* output, const float* input, const float* taps,
+                uint32_t count, uint32_t len) {
+    firImpl<16>(output, input, taps, count, len);
+}
+
+static void s16Generic(float* output, const void* input, uint32_t len) {
+    s16Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+static void s24Generic(float* output, const void* input, uint32_t len) {
+    s24Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+static void s32Generic(float* output, const void* input, uint32_t len) {
+    s32Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+#if defined(SIMD_X86)
+SIMD_AVX2 static void cmacAvx2(float* re, float* im, const float* reA, const float* imA,
+                const float* reB, const float* imB, uint32_t len) {
+    cmacImpl<true>(re, im, reA, imA, reB, imB, len);
+}
+
+SIMD_AVX2 static void scaleAvx2(float* output, const float* input, float gain, uint32_t len) {
+    scaleImpl(output, input, gain, len);
+}
+
+SIMD_AVX2 static void rampAvx2(float* output, const float* input, float gain, float step, uint32_t len) {
+    rampImpl(output, input, gain, step, len);
+}
+
+SIMD_AVX2 static void fadeAvx2(float* output, const float* a, const float* b,
+                float fade, float step, uint32_t len) {
+    fadeImpl(output, a, b, fade, step, len);
+}
+
+SIMD_AVX2 static void firAvx2(float* output, const float* input, const float* taps,
+                uint32_t count, uint32_t len) {
+    firImpl<32>(output, input, taps, count, len);
+}
+
+SIMD_AVX2 static void s16Avx2(float* output, const void* input, uint32_t len) {
+    s16Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+SIMD_AVX2 static void s24Avx2(float* output, const void* input, uint32_t len) {
+    s24Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+SIMD_AVX2 static void s32Avx2(float* output, const void* input, uint32_t len) {
+    s32Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+SIMD_AVX512 static void cmacAvx512(float* re, float* im, const float* reA, const float* imA,
+                const float* reB, const float* imB, uint32_t len) {
+    cmacImpl<true>(re, im, reA, imA, reB, imB, len);
+}
+
+SIMD_AVX512 static void scaleAvx512(float* output, const float* input, float gain, uint32_t len) {
+    scaleImpl(output, input, gain, len);
+}
+
+SIMD_AVX512 static void rampAvx512(float* output, const float* input, float gain, float step, uint32_t len) {
+    rampImpl(output, input, gain, step, len);
+}
+
+SIMD_AVX512 static void fadeAvx512(float* output, const float* a, const float* b,
+                float fade, float step, uint32_t len) {
+    fadeImpl(output, a, b, fade, step, len);
+}
+
+SIMD_AVX512 static void firAvx512(float* output, const float* input, const float* taps,
+                uint32_t count, uint32_t len) {
+    firImpl<64>(output, input, taps, count, len);
+}
+
+SIMD_AVX512 static void s16Avx512(float* output, const void* input, uint32_t len) {
+    s16Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+SIMD_AVX512 static void s24Avx512(float* output, const void* input, uint32_t len) {
+    s24Impl(output, static_cast<const uint8_t*>(input), len);
+}
+
+SIMD_AVX512 static void s32Avx512(float* output, const void* input, uint32_t len) {
+    s32Impl(output, static_cast<const uint8_t*>(input), len);
+}
+#endif
+
+/****************************************************************
+ ** dispatch
+ */
+
+void (*complexMultiplyAccumulate)(float* re, float* im,
+                const float* reA, const float* imA,
+                const float* reB, const float* imB, uint32_t len) = cmacGeneric;
+void (*scale)(float* output, const float* input, float gain, uint32_t len) = scaleGeneric;
+void (*ramp)(float* output, const float* input, float gain, float step, uint32_t len) = rampGeneric;
+void (*fade)(float* output, const float* a, const float* b,
+                float fade, float step, uint32_t len) = fadeGeneric;
+void (*fir)(float* output, const float* input, const float* taps,
+                uint32_t count, uint32_t len) = firGeneric;
+void (*convertS16)(float* output, const void* input, uint32_t len) = s16Generic;
+void (*convertS24)(float* output, const void* input, uint32_t len) = s24Generic;
+void (*convertS32)(float* output, const void* input, uint32_t len) = s32Generic;
+
+static Level currentLevel = GENERIC;
+
+static Level detect() {
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SSE2;
+#endif
+    return GENERIC;
+}
+
+Level init() {
+    static std::once_flag flag;
+    std::call_once(flag, [] () {
+        currentLevel = detect();
+        switch (currentLevel) {
+#if defined(SIMD_X86)
+            case AVX512:
+                complexMultiplyAccumulate = cmacAvx512;
+                scale = scaleAvx512;
+                ramp = rampAvx512;
+                fade = fadeAvx512;
+                fir = firAvx512;
+                convertS16 = s16Avx512;
+                convertS24 = s24Avx512;
+                convertS32 = s32Avx512;
+            break;
+            case AVX2:
+                complexMultiplyAccumulate = cmacAvx2;
+                scale = scaleAvx2;
+                ramp = rampAvx2;
+                fade = fadeAvx2;
+                fir = firAvx2;
+                convertS16 = s16Avx2;
+                convertS24 = s24Avx2;
+                convertS32 = s32Avx2;
+            break;
+#endif
+            default:
+                complexMultiplyAccumulate = cmacGeneric;
+                scale = scaleGeneric;
+                ramp = rampGeneric;
+                fade = fadeGeneric;
+                fir = firGeneric;
+                convertS16 = s16Generic;
+                convertS24 = s24Generic;
+                convertS32 = s32Generic;
+            break;
+        }
+    });
+    return currentLevel;
+}
+
+Level level() {
+    return currentLevel;
+}
+
+const char* levelName() {
+    switch (currentLevel) {
+        case SSE2:   return "SSE2";
+        case AVX2:   return "AVX2/FMA";
+        case AVX512: return "AVX-512/FMA";
+        default:     return "generic";
+    }
+}
+
+} // namespace simd
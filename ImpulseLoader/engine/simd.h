@@ -0,0 +1,61 @@
+/*
+ * simd.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <stdint.h>
+
+/****************************************************************
+ ** simd - run time selected vector kernels for the engine.
+ *         The kernels are build for several ISA levels in one binary,
+ *         init() select the best one supported by the running CPU.
+ */
+
+namespace simd {
+
+enum Level {
+    GENERIC = 0,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// select the kernels for the running CPU, could be called more then once
+Level init();
+Level level();
+const char* levelName();
+
+// result += a * b on split complex data
+extern void (*complexMultiplyAccumulate)(float* re, float* im,
+                const float* reA, const float* imA,
+                const float* reB, const float* imB, uint32_t len);
+// output = input * gain
+extern void (*scale)(float* output, const float* input, float gain, uint32_t len);
+// output = input * (gain + step * i), a linear gain ramp
+extern void (*ramp)(float* output, const float* input, float gain, float step, uint32_t len);
+// output = a + (fade + step * i) * (b - a), a linear crossfade from a to b,
+// output may be a or b
+extern void (*fade)(float* output, const float* a, const float* b,
+                float fade, float step, uint32_t len);
+// direct form FIR, output[i] += sum of taps[k] * input[i + k] for k < count,
+// the taps are in reverse order and input hold count - 1 samples history
+extern void (*fir)(float* output, const float* input, const float* taps,
+                uint32_t count, uint32_t len);
+// little endian PCM samples to float in the range -1 .. 1,
+// the input need no alignment
+extern void (*convertS16)(float* output, const void* input, uint32_t len);
+extern void (*convertS24)(float* output, const void* input, uint32_t len);
+extern void (*convertS32)(float* output, const void* input, uint32_t len);
+
+} // namespace simd
+
+#endif  // SIMD_H_
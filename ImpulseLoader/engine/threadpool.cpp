@@ -0,0 +1,429 @@
+/*
+ * threadpool.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#include "threadpool.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#if __cplusplus <= 201703L && defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/****************************************************************
+ ** ThreadPool
+ */
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::~ThreadPool()
+{
+    for (uint32_t i = 0; i < LANES; i++) {
+        if (isRunning(i)) stop(i);
+    }
+}
+
+uint64_t ThreadPool::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// a worker per core for the tails, one core is left for the process thread,
+// the IR loading don't need more then a few
+void ThreadPool::acquire()
+{
+    std::lock_guard<std::mutex> lk(mutex);
+    if (users++) return;
+    const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+    start(REALTIME, std::min(std::max(cores - 1, 1u), 8u), true);
+    start(BACKGROUND, std::min(std::max(cores / 2, 1u), 4u), false);
+}
+
+void ThreadPool::release()
+{
+    std::lock_guard<std::mutex> lk(mutex);
+    if (!users || --users) return;
+    stop(REALTIME);
+    stop(BACKGROUND);
+}
+
+void ThreadPool::start(uint32_t lane, uint32_t count, bool realtime)
+{
+    Lane& l = lanes[lane];
+    l.workers.clear();
+    for (uint32_t i = 0; i < count; i++) l.workers.emplace_back(new Worker());
+    l.count = count;
+    // spinning only help when the process thread has it's own core
+    l.spin = std::thread::hardware_concurrency() > 1;
+    l.pending.store(0, std::memory_order_release);
+    l.run.store(true, std::memory_order_release);
+    for (uint32_t i = 0; i < count; i++) {
+        Worker* w = l.workers[i].get();
+        w->thd = std::thread([this, lane, i]() { work(lane, i); });
+        if (realtime) setPolicy(w->thd, 25, 1); //SCHED_FIFO
+    }
+}
+
+// the threads finish the job they run, the jobs left in the slots are dropped
+void ThreadPool::stop(uint32_t lane)
+{
+    Lane& l = lanes[lane];
+    l.run.store(false, std::memory_order_release);
+    l.wake.fetch_add(1);
+    unpark(l.wake, true);
+    for (auto& w : l.workers) {
+        if (w->thd.joinable()) w->thd.join();
+    }
+    for (uint32_t i = 0; i < MAXJOBS; i++) {
+        PoolJob* job = l.slots[i].exchange(nullptr, std::memory_order_acq_rel);
+        if (!job) continue;
+        uint32_t s = PoolJob::QUEUED;
+        job->state.compare_exchange_strong(s, PoolJob::IDLE, std::memory_order_acq_rel);
+    }
+    l.pending.store(0, std::memory_order_release);
+}
+
+// put the job in a free slot, the caller hold it in SUBMITTING.
+// Only a CAS on the slot, a full lane let the caller run it.
+bool ThreadPool::submit(PoolJob* job) noexcept
+{
+    Lane& l = lanes[job->lane];
+    if (!l.run.load(std::memory_order_acquire)) return false;
+    for (uint32_t i = 0; i < MAXJOBS; i++) {
+        PoolJob* empty = nullptr;
+        if (l.slots[i].load(std::memory_order_relaxed) ||
+            !l.slots[i].compare_exchange_strong(empty, job, std::memory_order_acq_rel))
+            continue;
+        job->queue = i;
+        l.pending.fetch_add(1);
+        job->state.store(PoolJob::QUEUED, std::memory_order_release);
+        if (l.sleeping.load()) {
+            l.wake.fetch_add(1);
+            unpark(l.wake, false);
+        }
+        return true;
+    }
+    return false;
+}
+
+// empty the slot of a claimed job
+void ThreadPool::unqueue(PoolJob* job) noexcept
+{
+    Lane& l = lanes[job->lane];
+    if (job->queue >= MAXJOBS) return;
+    PoolJob* p = job;
+    if (l.slots[job->queue].compare_exchange_strong(p, nullptr, std::memory_order_acq_rel))
+        l.pending.fetch_sub(1);
+}
+
+// not for the audio thread, wait until no worker look at the slots
+// it may have seen before, the jobs out of the slots are then unseen
+void ThreadPool::quiesce(uint32_t lane) noexcept
+{
+    Lane& l = lanes[lane];
+    for (auto& w : l.workers) {
+        const uint32_t s = w->scan.load(std::memory_order_acquire);
+        if (!(s & 1)) continue;
+        while (w->scan.load(std::memory_order_acquire) == s)
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+// the queued job with the nearest deadline, claimed by it's state.
+// A lost race only mean to look again.
+PoolJob* ThreadPool::take(Lane& l) noexcept
+{
+    for (;;) {
+        PoolJob* best = nullptr;
+        uint64_t key = UINT64_MAX;
+        for (uint32_t i = 0; i < MAXJOBS; i++) {
+            PoolJob* job = l.slots[i].load(std::memory_order_acquire);
+            if (!job || job->state.load(std::memory_order_acquire) != PoolJob::QUEUED) continue;
+            const uint64_t d = job->deadline.load(std::memory_order_relaxed);
+            const uint64_t k = d ? d : UINT64_MAX;
+            if (!best || k < key) {
+                best = job;
+                key = k;
+            }
+        }
+        if (!best) return nullptr;
+        if (best->claim()) return best;
+    }
+}
+
+// the time from the hand over to the start of the job
+void ThreadPool::handedOver(Lane& l, PoolJob* job) noexcept
+{
+    const uint64_t t = now();
+    const uint64_t d = t > job->queuedAt ? t - job->queuedAt : 0;
+    job->handoff.store(d, std::memory_order_relaxed);
+    l.handoffCount.fetch_add(1, std::memory_order_relaxed);
+    l.handoffSum.fetch_add(d, std::memory_order_relaxed);
+    uint64_t m = l.handoffMax.load(std::memory_order_relaxed);
+    while (d > m && !l.handoffMax.compare_exchange_weak(m, d, std::memory_order_relaxed));
+}
+
+void ThreadPool::handoff(uint32_t lane, double* mean, uint64_t* max) noexcept
+{
+    Lane& l = lanes[lane];
+    const uint64_t n = l.handoffCount.exchange(0, std::memory_order_relaxed);
+    const uint64_t sum = l.handoffSum.exchange(0, std::memory_order_relaxed);
+    *max = l.handoffMax.exchange(0, std::memory_order_relaxed);
+    *mean = n ? static_cast<double>(sum) / n : 0.0;
+}
+
+// a worker spin a while before it sleep, the time is adapted to the gaps
+// between the jobs: it grow when the worker is woken soon after it went
+// to sleep, and shrink when the spinning was for nothing
+void ThreadPool::work(uint32_t lane, uint32_t self)
+{
+    Lane& l = lanes[lane];
+    uint64_t spin = l.spin ? MAXSPIN / 4 : 0;
+    Worker* me = l.workers[self].get();
+    while (l.run.load(std::memory_order_acquire)) {
+        me->scan.fetch_add(1, std::memory_order_acq_rel);
+        PoolJob* job = l.pending.load(std::memory_order_acquire) ? take(l) : nullptr;
+        me->scan.fetch_add(1, std::memory_order_acq_rel);
+        if (job) {
+            handedOver(l, job);
+            job->execute();
+            continue;
+        }
+        if (spin) {
+            const uint64_t end = now() + spin;
+            bool found = false;
+            for (uint32_t i = 1; l.run.load(std::memory_order_relaxed); i++) {
+                if (l.pending.load(std::memory_order_relaxed)) {
+                    found = true;
+                    break;
+                }
+                if (!(i & 63) && now() > end) break;
+                relax();
+            }
+            if (found) continue;
+            spin /= 2;
+            if (spin < MINSPIN) spin = 0;
+        }
+        // sleep until a job is queued, submit() see the sleeper
+        // or the worker see the pending job
+        const uint64_t sleep = now();
+        l.sleeping.fetch_add(1);
+        const uint32_t w = l.wake.load();
+        if (!l.pending.load() && l.run.load(std::memory_order_acquire)) park(l.wake, w);
+        l.sleeping.fetch_sub(1);
+        if (l.spin && now() - sleep < 2 * MAXSPIN) spin = std::min(2 * spin + MINSPIN, MAXSPIN);
+    }
+}
+
+// C++20 atomic wait, with C++17 the futex on linux
+void ThreadPool::park(std::atomic<uint32_t>& word, uint32_t old) noexcept
+{
+    #if __cplusplus > 201703L
+    word.wait(old);
+    #elif defined(__linux__)
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word");
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, old,
+            nullptr, nullptr, 0);
+    #else
+    if (word.load() == old) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    #endif
+}
+
+void ThreadPool::unpark(std::atomic<uint32_t>& word, bool all) noexcept
+{
+    #if __cplusplus > 201703L
+    if (all) word.notify_all();
+    else word.notify_one();
+    #elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+            all ? INT32_MAX : 1, nullptr, nullptr, 0);
+    #else
+    (void)word;
+    (void)all;
+    #endif
+}
+
+// set thread scheduling class and priority level, like ParallelThread does
+void ThreadPool::setPolicy(std::thread& thd, int32_t rt_prio, int32_t rt_policy)
+{
+    #if defined(__linux__) || defined(_UNIX) || defined(__APPLE__) || defined(_OS_UNIX_)
+    sched_param sch_params;
+    if (rt_prio == 0) {
+        rt_prio = sched_get_priority_max(rt_policy);
+    }
+    if ((rt_prio/5) > 0) rt_prio = rt_prio/5;
+    sch_params.sched_priority = rt_prio;
+    if (pthread_setschedparam(thd.native_handle(), rt_policy, &sch_params)) {
+        fprintf(stderr, "ThreadPool: fail to set priority\n");
+    }
+    #elif defined(_WIN32)
+    if (SetThreadPriority(thd.native_handle(), 24)) {
+        fprintf(stderr, "ThreadPool: fail to set priority\n");
+    }
+    #endif
+}
+
+/****************************************************************
+ ** PoolJob
+ */
+
+PoolJob::PoolJob(uint32_t lane_)
+    : state(IDLE), handoff(0), deadline(0), queuedAt(0), lane(lane_),
+      queue(UINT32_MAX)
+{
+    timeoutPeriod = 400;
+    maxWait = 5;
+    #ifdef __MOD_DEVICES__
+    maxWait = 7;
+    #endif
+}
+
+PoolJob::~PoolJob()
+{
+    stop();
+}
+
+// a job handed over while it run is run once more when done
+void PoolJob::runProcess(uint64_t deadline_) noexcept
+{
+    uint32_t s = state.load(std::memory_order_acquire);
+    for (;;) {
+        if (s == IDLE || s == DONE) {
+            if (!state.compare_exchange_weak(s, SUBMITTING, std::memory_order_acq_rel)) continue;
+            deadline.store(deadline_, std::memory_order_relaxed);
+            HostQueue* hq = HostQueue::current;
+            if (lane == ThreadPool::REALTIME && hq && hq->push(this)) {
+                queue = HOSTQUEUE;
+                state.store(QUEUED, std::memory_order_release);
+                return;
+            }
+            queuedAt = ThreadPool::now();
+            if (!ThreadPool::instance().submit(this)) {
+                state.store(RUNNING, std::memory_order_release);
+                execute();
+            }
+            return;
+        }
+        if (s == RUNNING) {
+            if (!state.compare_exchange_weak(s, RERUN, std::memory_order_acq_rel)) continue;
+        }
+        // a queued job will see the new data
+        return;
+    }
+}
+
+// the state is the only thing touched after process(),
+// so the owner may destroy the job as soon as it see DONE
+void PoolJob::execute() noexcept
+{
+    for (;;) {
+        process();
+        uint32_t s = RUNNING;
+        if (state.compare_exchange_strong(s, DONE, std::memory_order_acq_rel)) return;
+        state.store(RUNNING, std::memory_order_release);
+    }
+}
+
+// only atomics are touched here, it spin a short while, as the job is
+// likely done soon, then yield until the time out is over
+bool PoolJob::processWait() noexcept
+{
+    uint32_t s = state.load(std::memory_order_acquire);
+    if (s == IDLE) return true;
+    // not started yet, so run it here
+    if (s == QUEUED && claim()) execute();
+    const uint64_t start = ThreadPool::now();
+    const uint64_t spinEnd = start + SPINWAIT;
+    const uint64_t end = start + static_cast<uint64_t>(timeoutPeriod) * maxWait * 1000;
+    for (uint32_t i = 1; ; i++) {
+        s = state.load(std::memory_order_acquire);
+        if (s == IDLE || s == DONE) break;
+        if (i & 63) {
+            ThreadPool::relax();
+            continue;
+        }
+        const uint64_t t = ThreadPool::now();
+        if (t > end) return false;
+        if (t > spinEnd) std::this_thread::yield();
+    }
+    if (s == DONE) state.compare_exchange_strong(s, IDLE, std::memory_order_acq_rel);
+    return true;
+}
+
+// not for the audio thread, wait until a running job is done
+// and no worker hold a pointer to it
+void PoolJob::stop() noexcept
+{
+    for (;;) {
+        const uint32_t s = state.load(std::memory_order_acquire);
+        if (s == QUEUED && claim()) break;
+        if (s == IDLE || s == DONE) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    state.store(IDLE, std::memory_order_release);
+    ThreadPool::instance().quiesce(lane);
+}
+
+// take the job from the slot it wait in, only one of the workers,
+// the owner or the host pool win the CAS
+bool PoolJob::claim() noexcept
+{
+    uint32_t s = QUEUED;
+    if (!state.compare_exchange_strong(s, RUNNING, std::memory_order_acq_rel)) return false;
+    if (queue != HOSTQUEUE) ThreadPool::instance().unqueue(this);
+    return true;
+}
+
+/****************************************************************
+ ** HostQueue
+ */
+
+thread_local HostQueue* HostQueue::current = nullptr;
+
+void HostQueue::open() noexcept
+{
+    count = 0;
+    current = this;
+}
+
+uint32_t HostQueue::close() noexcept
+{
+    current = nullptr;
+    return count;
+}
+
+// a job already waited for in the process call is skipped
+void HostQueue::run(uint32_t index) noexcept
+{
+    if (index >= count) return;
+    if (jobs[index]->claim()) jobs[index]->execute();
+}
+
+void HostQueue::release() noexcept
+{
+    for (uint32_t i = 0; i < count; i++) {
+        PoolJob* job = jobs[i];
+        if (!job->claim()) continue;
+        job->state.store(PoolJob::SUBMITTING, std::memory_order_release);
+        job->queue = UINT32_MAX;
+        if (!ThreadPool::instance().submit(job)) {
+            job->state.store(PoolJob::RUNNING, std::memory_order_release);
+            job->execute();
+        }
+    }
+    count = 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * threadpool.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+
+#pragma once
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include "ParallelThread.h"
+
+
+class PoolJob;
+class HostQueue;
+
+/****************************************************************
+ ** ThreadPool - the process wide worker threads for all instances,
+ *               instead of a thread per convolver and engine.
+ *               The realtime lane run the convolver tails, sized to the
+ *               cores, the background lane load the IR-Files.
+ *               The jobs wait in a array of slots per lane, a idle worker
+ *               take the one with the nearest deadline. A slot is filled
+ *               and emptied with a CAS, a job is claimed with a CAS on
+ *               it's state, so no thread ever wait for a lock here.
+ *               The threads run while a Engine hold the pool, without
+ *               them the jobs run in the calling thread.
+ */
+
+class ThreadPool
+{
+public:
+    enum {
+        REALTIME,
+        BACKGROUND,
+        LANES
+    };
+
+    static ThreadPool& instance();
+
+    void acquire();
+    void release();
+
+    inline bool isRunning(uint32_t lane) const {
+        return lanes[lane].run.load(std::memory_order_acquire);}
+    uint32_t workers(uint32_t lane) const { return lanes[lane].count;}
+
+    // the clock used for the deadlines, in ns
+    static uint64_t now();
+
+    // the time from runProcess() to the start of the jobs in a worker,
+    // the mean and the max in ns since the last call
+    void handoff(uint32_t lane, double* mean, uint64_t* max) noexcept;
+
+    // a pause in a spin loop
+    static inline void relax() noexcept {
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+        #endif
+    }
+
+private:
+    friend class PoolJob;
+    friend class HostQueue;
+    static constexpr uint32_t MAXJOBS = 128;
+    // the spin time of a idle worker before it sleep, in ns
+    static constexpr uint64_t MINSPIN = 1000;
+    static constexpr uint64_t MAXSPIN = 100000;
+
+    struct Worker {
+        std::thread thd;
+        // odd while the worker look at the slots, a job is only
+        // destroyed when no worker may still hold a pointer to it
+        std::atomic<uint32_t> scan;
+
+        Worker() : scan(0) {}
+    };
+
+    struct Lane {
+        std::vector<std::unique_ptr<Worker> > workers;
+        uint32_t count;
+        bool spin;
+        std::atomic<bool> run;
+        std::atomic<PoolJob*> slots[MAXJOBS];
+        std::atomic<uint32_t> pending;
+        std::atomic<uint32_t> sleeping;
+        // the futex word the sleeping workers wait on
+        std::atomic<uint32_t> wake;
+        std::atomic<uint64_t> handoffCount;
+        std::atomic<uint64_t> handoffSum;
+        std::atomic<uint64_t> handoffMax;
+
+        Lane() : count(0), spin(false), run(false), pending(0), sleeping(0), wake(0),
+                 handoffCount(0), handoffSum(0), handoffMax(0) {
+            for (uint32_t i = 0; i < MAXJOBS; i++) slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    Lane lanes[LANES];
+    std::mutex mutex;
+    uint32_t users;
+
+    void start(uint32_t lane, uint32_t count, bool realtime);
+    void stop(uint32_t lane);
+    bool submit(PoolJob* job) noexcept;
+    void unqueue(PoolJob* job) noexcept;
+    void quiesce(uint32_t lane) noexcept;
+    PoolJob* take(Lane& l) noexcept;
+    void handedOver(Lane& l, PoolJob* job) noexcept;
+    void work(uint32_t lane, uint32_t self);
+    // sleep while word is old, and wake the sleepers
+    static void park(std::atomic<uint32_t>& word, uint32_t old) noexcept;
+    static void unpark(std::atomic<uint32_t>& word, bool all) noexcept;
+    static void setPolicy(std::thread& thd, int32_t rt_prio, int32_t rt_policy);
+
+    ThreadPool() : users(0) {}
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+};
+
+/****************************************************************
+ ** PoolJob - a job run by the ThreadPool, used like a ParallelThread:
+ *            the function is set with set<Class, &Class::function>(this),
+ *            runProcess() hand it to the pool, processWait() wait for it.
+ *            A job no worker picked up yet is run by processWait()
+ *            in the calling thread, so it's never lost in a queue.
+ *            The hand over and the wait only touch atomics, a sleeping
+ *            worker is woken by a futex, no locks or condition variables
+ *            in the audio thread.
+ */
+
+class PoolJob : public ProcessPtr
+{
+public:
+    // check if the job is done, return true when it could be run again
+    inline bool getProcess() const noexcept {
+        const uint32_t s = state.load(std::memory_order_acquire);
+        return s == IDLE || s == DONE;
+    }
+
+    // hand the job to the pool, the result is needed before the deadline
+    // (ThreadPool::now() based), 0 when there is none. When the job still
+    // run it's run once more, without the pool it's run here.
+    void runProcess(uint64_t deadline_ = 0) noexcept;
+
+    // wait for the job, as max 5 times the time out, return false when
+    // the time is over and the job still run
+    bool processWait() noexcept;
+
+    // the last time from runProcess() to the start in a worker, in ns
+    inline uint64_t latency() const noexcept { return handoff.load(std::memory_order_relaxed);}
+
+    // wait for the job without time out, before destruction
+    void stop() noexcept;
+
+    // set the time out for processWait() in micro seconds
+    void setTimeOut(uint32_t timeout) noexcept { timeoutPeriod = timeout;}
+
+    explicit PoolJob(uint32_t lane_ = ThreadPool::REALTIME);
+    ~PoolJob();
+    PoolJob(const PoolJob&) = delete;
+    PoolJob& operator=(const PoolJob&) = delete;
+
+private:
+    friend class ThreadPool;
+    friend class HostQueue;
+    // the queue value of a job in a HostQueue
+    static constexpr uint32_t HOSTQUEUE = UINT32_MAX - 1;
+    enum {
+        IDLE,
+        QUEUED,
+        RUNNING,
+        // handed over again while it run
+        RERUN,
+        DONE,
+        // put in a slot by runProcess(), not claimable yet
+        SUBMITTING
+    };
+
+    // the time processWait() spin before it yield, in ns
+    static constexpr uint64_t SPINWAIT = 20000;
+
+    std::atomic<uint32_t> state;
+    std::atomic<uint64_t> handoff;
+    // read by the workers while they look for the nearest one
+    std::atomic<uint64_t> deadline;
+    uint64_t queuedAt;
+    uint32_t lane;
+    // the slot the job wait in
+    uint32_t queue;
+    uint32_t timeoutPeriod;
+    uint32_t maxWait;
+
+    void execute() noexcept;
+    bool claim() noexcept;
+};
+
+/****************************************************************
+ ** HostQueue - the realtime jobs started in a process call, for a host
+ *              which run them in it's own thread pool (CLAP thread-pool).
+ *              While the queue is open in the process thread, the
+ *              realtime jobs handed over there wait here, the host run them
+ *              by index before the process call ends. When the host reject
+ *              them, release() hand them to the ThreadPool.
+ */
+
+class HostQueue
+{
+public:
+    // [audio-thread]
+    void open() noexcept;
+    // stop to collect jobs, return the count of them
+    uint32_t close() noexcept;
+    // [host pool threads]
+    void run(uint32_t index) noexcept;
+    void release() noexcept;
+
+    HostQueue() : count(0) {}
+
+private:
+    friend class PoolJob;
+    static constexpr uint32_t MAXJOBS = 64;
+    static thread_local HostQueue* current;
+    PoolJob* jobs[MAXJOBS];
+    uint32_t count;
+
+    inline bool push(PoolJob* job) noexcept {
+        if (count >= MAXJOBS) return false;
+        jobs[count++] = job;
+        return true;
+    }
+};
+
+#endif  // THREADPOOL_H_
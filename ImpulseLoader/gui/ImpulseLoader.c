@@ -131,7 +131,7 @@ static void file_menu_callback(void *w_, void* user_data) {
 
 void plugin_set_window_size(int *w,int *h,const char * plugin_uri) {
     (*w) = 500; //set initial width of main window
-    (*h) = 309; //set initial height of main window
+    (*h) = 389; //set initial height of main window
 }
 
 const char* plugin_set_name() {
@@ -149,6 +149,10 @@ void plugin_create_controller_widgets(X11_UI *ui, const char * plugin_uri) {
     ps->ir.filename = strdup("None");
     ps->ir.dir_name = NULL;
     ps->fname = NULL;
+    ps->irLength = 0.0;
+    ps->irSaving = 0.0;
+    ps->misses = 0.0;
+    ps->adaptations = 0.0;
     ps->ir.filepicker = (FilePicker*)malloc(sizeof(FilePicker));
     fp_init(ps->ir.filepicker, "/");
     asprintf(&ps->ir.filepicker->filter ,"%s", ".wav|.WAV");
@@ -156,7 +160,7 @@ void plugin_create_controller_widgets(X11_UI *ui, const char * plugin_uri) {
 
 // IR
 
-    ps->ir.filebutton = add_lv2_irfile_button (ps->ir.filebutton, ui->win, -3, "IR File", ui, 45,  258, 25, 25);
+    ps->ir.filebutton = add_lv2_irfile_button (ps->ir.filebutton, ui->win, -3, "IR File", ui, 45,  338, 25, 25);
     ps->ir.filebutton->parent_struct = (void*)&ps->ir;
     ps->ir.filebutton->func.user_callback = file_load_response;
 
@@ -177,14 +181,49 @@ void plugin_create_controller_widgets(X11_UI *ui, const char * plugin_uri) {
     set_widget_color(ui->widget[2], (Color_state)0, (Color_mod)0, 0.3, 0.55, 0.91, 1.0);
     set_widget_color(ui->widget[2], (Color_state)0, (Color_mod)3,  0.682, 0.686, 0.686, 1.0);
 
-    ps->ir.fbutton = add_lv2_button(ps->ir.fbutton, ui->win, "", ui, 435,  254, 22, 30);
+    ps->ir.fbutton = add_lv2_button(ps->ir.fbutton, ui->win, "", ui, 435,  334, 22, 30);
     ps->ir.fbutton->parent_struct = (void*)&ps->ir;
     combobox_set_pop_position(ps->ir.fbutton, 0);
     combobox_set_entry_length(ps->ir.fbutton, 48);
     combobox_add_entry(ps->ir.fbutton, "None");
     ps->ir.fbutton->func.value_changed_callback = file_menu_callback;
 
-    ui->widget[3] = add_lv2_toggle_button (ui->widget[3], ui->win, 7, "", ui, 75,  258, 25, 25);
+    ui->widget[3] = add_lv2_toggle_button (ui->widget[3], ui->win, 7, "", ui, 75,  338, 25, 25);
+
+    ui->widget[4] = add_lv2_trim_button (ui->widget[4], ui->win, 10, "", ui, 405,  338, 25, 25);
+
+    ui->widget[5] = add_lv2_minphase_button (ui->widget[5], ui->win, 13, "", ui, 105,  338, 25, 25);
+
+// IR gain, pre-delay and the part of the IR to use
+
+    ui->widget[6] = add_lv2_knob (ui->widget[6], ui->win, 14, "IR Gain", ui, 52,  225, 70, 80);
+    set_adjustment(ui->widget[6]->adj, 0.0, 0.0, -20.0, 20.0, 0.1, CL_CONTINUOS);
+    set_widget_color(ui->widget[6], (Color_state)0, (Color_mod)0, 0.3, 0.55, 0.91, 1.0);
+    set_widget_color(ui->widget[6], (Color_state)0, (Color_mod)3,  0.682, 0.686, 0.686, 1.0);
+
+    ui->widget[7] = add_lv2_knob (ui->widget[7], ui->win, 15, "Delay", ui, 160,  225, 70, 80);
+    set_adjustment(ui->widget[7]->adj, 0.0, 0.0, 0.0, 500.0, 1.0, CL_CONTINUOS);
+    set_widget_color(ui->widget[7], (Color_state)0, (Color_mod)0, 0.3, 0.55, 0.91, 1.0);
+    set_widget_color(ui->widget[7], (Color_state)0, (Color_mod)3,  0.682, 0.686, 0.686, 1.0);
+
+    ui->widget[8] = add_lv2_knob (ui->widget[8], ui->win, 16, "Offset", ui, 270,  225, 70, 80);
+    set_adjustment(ui->widget[8]->adj, 0.0, 0.0, 0.0, 1000.0, 1.0, CL_CONTINUOS);
+    set_widget_color(ui->widget[8], (Color_state)0, (Color_mod)0, 0.3, 0.55, 0.91, 1.0);
+    set_widget_color(ui->widget[8], (Color_state)0, (Color_mod)3,  0.682, 0.686, 0.686, 1.0);
+
+    ui->widget[9] = add_lv2_knob (ui->widget[9], ui->win, 17, "Length", ui, 378,  225, 70, 80);
+    set_adjustment(ui->widget[9]->adj, 0.0, 0.0, 0.0, 10000.0, 10.0, CL_CONTINUOS);
+    set_widget_color(ui->widget[9], (Color_state)0, (Color_mod)0, 0.3, 0.55, 0.91, 1.0);
+    set_widget_color(ui->widget[9], (Color_state)0, (Color_mod)3,  0.682, 0.686, 0.686, 1.0);
+
+// the latency mode, the convolution run in fixed blocks
+    ui->widget[10] = add_lv2_combobox (ui->widget[10], ui->win, 20, "Latency", ui, 365,  18, 120, 24);
+    combobox_add_entry(ui->widget[10], "No Latency");
+    combobox_add_entry(ui->widget[10], "256 Samples");
+    combobox_add_entry(ui->widget[10], "512 Samples");
+    combobox_add_entry(ui->widget[10], "1024 Samples");
+    adj_set_value(ui->widget[10]->adj, 0.0);
+
     //ui->widget[13] = add_lv2_erase_button (ui->widget[13], ui->elem[0], 17, "", ui, 470, 24, 25, 25);
 
 }
@@ -218,9 +218,25 @@ static void draw_window(void *w_, void* user_data) {
 
         cairo_text_extents(w->crb, label, &extents_f);
         double twf = extents_f.width/2.0;
-        cairo_move_to (w->crb, max(100 * w->app->hdpi,(w->scale.init_width*0.5)-twf), w->scale.init_height-35 * w->app->hdpi );
+        cairo_move_to (w->crb, max(135 * w->app->hdpi,(w->scale.init_width*0.5)-twf), w->scale.init_height-35 * w->app->hdpi );
         cairo_show_text(w->crb, label);       
     }
+    if (ps->irLength > 0.0) {
+        char info[128];
+        int len;
+        if (ps->irSaving > 0.5)
+            len = snprintf(info, sizeof(info), "IR %.1f ms, trimmed %.0f%% CPU", ps->irLength, ps->irSaving);
+        else
+            len = snprintf(info, sizeof(info), "IR %.1f ms", ps->irLength);
+        if (ps->misses > 0.5 && len > 0 && len < (int)sizeof(info))
+            snprintf(info + len, sizeof(info) - len, ", %.0f missed, %.0f adapted",
+                                                    ps->misses, ps->adaptations);
+        cairo_text_extents_t extents_i;
+        cairo_set_font_size (w->crb, w->app->normal_font);
+        cairo_text_extents(w->crb, info, &extents_i);
+        cairo_move_to (w->crb, (w->scale.init_width*0.5)-extents_i.width/2.0, w->scale.init_height-63 * w->app->hdpi );
+        cairo_show_text(w->crb, info);
+    }
     widget_reset_scale(w);
 
     cairo_pop_group_to_source (w->crb);
@@ -903,6 +919,16 @@ Widget_t* add_lv2_button(Widget_t *w, Widget_t *p, const char * label,
     return w;
 }
 
+Widget_t* add_lv2_combobox(Widget_t *w, Widget_t *p, int index, const char * label,
+                                X11_UI* ui, int x, int y, int width, int height) {
+    w = add_combobox(p, label, x, y, width, height);
+    w->parent_struct = ui;
+    w->data = index;
+    w->func.expose_callback = draw_my_combobox;
+    w->func.value_changed_callback = value_changed;
+    return w;
+}
+
 static void my_fdialog_response(void *w_, void* user_data) {
     Widget_t *w = (Widget_t*)w_;
     FileButton *filebutton = (FileButton *)w->private_struct;
@@ -1050,6 +1076,28 @@ Widget_t* add_lv2_toggle_button(Widget_t *w, Widget_t *p, int index, const char
     return w;
 }
 
+Widget_t* add_lv2_trim_button(Widget_t *w, Widget_t *p, int index, const char * label,
+                                X11_UI* ui, int x, int y, int width, int height) {
+    w = add_image_toggle_button(p, "", x, y, width, height);
+    w->parent_struct = ui;
+    w->data = index;
+    widget_get_png(w, LDVAR(trim_png));
+    w->func.expose_callback = draw_i_button;
+    w->func.value_changed_callback = value_changed;
+    return w;
+}
+
+Widget_t* add_lv2_minphase_button(Widget_t *w, Widget_t *p, int index, const char * label,
+                                X11_UI* ui, int x, int y, int width, int height) {
+    w = add_image_toggle_button(p, "", x, y, width, height);
+    w->parent_struct = ui;
+    w->data = index;
+    widget_get_png(w, LDVAR(minphase_png));
+    w->func.expose_callback = draw_i_button;
+    w->func.value_changed_callback = value_changed;
+    return w;
+}
+
 Widget_t* add_lv2_erase_button(Widget_t *w, Widget_t *p, int index, const char * label,
                                 X11_UI* ui, int x, int y, int width, int height) {
     w = add_image_button(p, "", x, y, width, height);
@@ -20,7 +20,7 @@
 extern "C" {
 #endif
 
-#define CONTROLS 4
+#define CONTROLS 11
 
 #define GUI_ELEMENTS 0
 
@@ -39,6 +39,12 @@ typedef struct {
 typedef struct {
     ModelPicker ir;
     char *fname;
+    // IR length in ms and CPU saved by trimming in %
+    float irLength;
+    float irSaving;
+    // the missed deadlines and the reactions on them
+    float misses;
+    float adaptations;
 } X11_UI_Private_t;
 
 // main window struct
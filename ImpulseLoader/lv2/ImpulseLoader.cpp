@@ -42,15 +42,33 @@ private:
     int32_t                      rt_policy;
     float*                       input0;
     float*                       output0;
+    float*                       input1;
+    float*                       output1;
     float*                       _bypass;
     float*                       _gain;
     float*                       _wet_dry;
     float*                       _normA;
+    float*                       _trimA;
+    float*                       _minphaseA;
+    float*                       _irGain;
+    float*                       _delay;
+    float*                       _offset;
+    float*                       _length;
+    float*                       _irLength;
+    float*                       _irSaving;
+    float*                       _misses;
+    float*                       _adaptations;
+    float*                       _latencyA;
+    float*                       _latency;
 
     uint32_t                     s_rate;
     double                       s_time;
     int                          processCounter;
     bool                         doit;
+    bool                         stereo;
+    bool                         monoIn;
+    // the host told the nominal block size, the max one is then ignored
+    bool                         nominalSize;
 
     std::atomic<bool>            _restore;
 
@@ -74,6 +92,8 @@ public:
                 LV2_State_Handle handle, const LV2_URID urid, std::string *file);
     // LV2 Descriptor
     static const LV2_Descriptor descriptor;
+    static const LV2_Descriptor descriptorStereo;
+    static const LV2_Descriptor descriptorMonoStereo;
     static const void* extension_data(const char* uri);
     // static wrapper to private functions
     static void deactivate(LV2_Handle instance);
@@ -104,6 +124,9 @@ public:
     static LV2_Worker_Status work_response(LV2_Handle  instance,
                                          uint32_t    size,
                                          const void* data);
+
+    static uint32_t get_options(LV2_Handle instance, LV2_Options_Option* options);
+    static uint32_t set_options(LV2_Handle instance, const LV2_Options_Option* options);
     Ximpulseloader();
     ~Ximpulseloader();
 };
@@ -115,10 +138,27 @@ Ximpulseloader::Ximpulseloader() :
     rt_policy(0),
     input0(NULL),
     output0(NULL),
+    input1(NULL),
+    output1(NULL),
     _bypass(0),
     _gain(0),
     _wet_dry(0),
-    _normA(0) {
+    _normA(0),
+    _trimA(0),
+    _minphaseA(0),
+    _irGain(0),
+    _delay(0),
+    _offset(0),
+    _length(0),
+    _irLength(0),
+    _irSaving(0),
+    _misses(0),
+    _adaptations(0),
+    _latencyA(0),
+    _latency(0),
+    stereo(false),
+    monoIn(false),
+    nominalSize(false) {
         map = nullptr;
         schedule = nullptr;
         control = nullptr;
@@ -146,9 +186,14 @@ void Ximpulseloader::init_dsp_(uint32_t rate)
     _restore.store(false, std::memory_order_release);
 }
 
-// connect the Ports used by the plug-in class
+// connect the Ports used by the plug-in class,
+// the mono plugin lack the ports 8 and 9 (in1, out1), the mono in,
+// stereo out plugin the port 8 (in1), so the following ports get the
+// same index as in the stereo plugin
 void Ximpulseloader::connect_(uint32_t port,void* data)
 {
+    if (!stereo && port > 7) port += 2;
+    else if (monoIn && port > 7) port += 1;
     switch (port)
     {
         case 0:
@@ -175,6 +220,48 @@ void Ximpulseloader::connect_(uint32_t port,void* data)
         case 7:
             _normA = static_cast<float*>(data);
             break;
+        case 8:
+            input1 = static_cast<float*>(data);
+            break;
+        case 9:
+            output1 = static_cast<float*>(data);
+            break;
+        case 10:
+            _trimA = static_cast<float*>(data);
+            break;
+        case 11:
+            _irLength = static_cast<float*>(data);
+            break;
+        case 12:
+            _irSaving = static_cast<float*>(data);
+            break;
+        case 13:
+            _minphaseA = static_cast<float*>(data);
+            break;
+        case 14:
+            _irGain = static_cast<float*>(data);
+            break;
+        case 15:
+            _delay = static_cast<float*>(data);
+            break;
+        case 16:
+            _offset = static_cast<float*>(data);
+            break;
+        case 17:
+            _length = static_cast<float*>(data);
+            break;
+        case 18:
+            _misses = static_cast<float*>(data);
+            break;
+        case 19:
+            _adaptations = static_cast<float*>(data);
+            break;
+        case 20:
+            _latencyA = static_cast<float*>(data);
+            break;
+        case 21:
+            _latency = static_cast<float*>(data);
+            break;
         default:
             break;
     }
@@ -246,8 +333,6 @@ inline void Ximpulseloader::check_messages(uint32_t n_samples)
     lv2_atom_forge_set_buffer(&forge, (uint8_t*)notify, notify_capacity);
     lv2_atom_forge_sequence_head(&forge, &notify_frame, 0);
 
-    engine.bufsize = n_samples;
-
     LV2_ATOM_SEQUENCE_FOREACH(control, ev) {
         if (lv2_atom_forge_is_object_type(&forge, ev->body.type)) {
             const LV2_Atom_Object* obj = (LV2_Atom_Object*)&ev->body;
@@ -270,16 +355,52 @@ inline void Ximpulseloader::check_messages(uint32_t n_samples)
     engine.plugin1->gain = static_cast<float>(*_gain);
     engine.plugin2->dry_wet = static_cast<float>(*_wet_dry);
 
-    // check if normalisation is pressed for conv
-    if (engine.normA != static_cast<uint32_t>(*(_normA))) {
-        engine.normA = static_cast<uint32_t>(*(_normA));
+    // normalisation is a smoothed gain in the engine, no reload needed
+    engine.normA = static_cast<uint32_t>(*(_normA));
+
+    // check if trimming is pressed for conv
+    if (engine.trimA != static_cast<uint32_t>(*(_trimA))) {
+        engine.trimA = static_cast<uint32_t>(*(_trimA));
         engine._cd.fetch_add(1, std::memory_order_relaxed);
-        engine.conv.set_normalisation(engine.normA);
         if (engine.ir_file.compare("None") != 0) {
             if (!doit) doit = true;
         }
     }
 
+    // check if minimum phase is pressed for conv
+    if (engine.minphaseA != static_cast<uint32_t>(*(_minphaseA))) {
+        engine.minphaseA = static_cast<uint32_t>(*(_minphaseA));
+        engine._cd.fetch_add(1, std::memory_order_relaxed);
+        if (engine.ir_file.compare("None") != 0) {
+            if (!doit) doit = true;
+        }
+    }
+
+    // check if the IR gain, pre-delay, offset or length changed,
+    // the convolver is set up again from the cached IR
+    if (engine.irGainA != *(_irGain) || engine.delayA != *(_delay) ||
+        engine.offsetA != *(_offset) || engine.lengthA != *(_length)) {
+        engine.irGainA = *(_irGain);
+        engine.delayA = *(_delay);
+        engine.offsetA = *(_offset);
+        engine.lengthA = *(_length);
+        engine._cd.store(1, std::memory_order_relaxed);
+        if (engine.ir_file.compare("None") != 0) {
+            if (!doit) doit = true;
+        }
+    }
+
+    // report the IR length and the CPU saved by trimming
+    *(_irLength) = engine.irLength.load(std::memory_order_relaxed);
+    *(_irSaving) = engine.irSaving.load(std::memory_order_relaxed);
+    // and the missed deadlines and the reactions on them
+    *(_misses) = static_cast<float>(engine.misses.load(std::memory_order_relaxed));
+    *(_adaptations) = static_cast<float>(engine.adaptations.load(std::memory_order_relaxed));
+
+    // the latency mode reblock the audio, the host get the delay to compensate it
+    engine.latencyA = static_cast<uint32_t>(*(_latencyA));
+    *(_latency) = static_cast<float>(engine.get_latency());
+
     // check if a model or IR file is to be removed
  /*   if ((*_eraseIr)) {
         engine._cd.fetch_add(1, std::memory_order_relaxed);
@@ -293,6 +414,12 @@ inline void Ximpulseloader::check_messages(uint32_t n_samples)
         _restore.store(false, std::memory_order_release);
     }
 
+    // plan the partitions again when the block size changed
+    if (engine.replan()) {
+        engine._cd.store(1, std::memory_order_relaxed);
+        if (!doit) doit = true;
+    }
+
     // run worker thread when needed
     if (doit && !engine._execute.load(std::memory_order_acquire)) {
         engine._execute.store(true, std::memory_order_release);
@@ -317,6 +444,10 @@ inline void Ximpulseloader::runBufferedDsp(uint32_t n_samples)
     // doing in place processing
     if(output0 != input0)
         memcpy(output0, input0, n_samples*sizeof(float));
+    if(monoIn)
+        memcpy(output1, input0, n_samples*sizeof(float));
+    else if(stereo && output1 != input1)
+        memcpy(output1, input1, n_samples*sizeof(float));
 
     // the early bird die
     if (processCounter < 5) {
@@ -326,7 +457,10 @@ inline void Ximpulseloader::runBufferedDsp(uint32_t n_samples)
     // check atom messages (full cycle)
     check_messages(n_samples);
     // run engine
-    engine.process(n_samples, output0, output0);
+    if (stereo)
+        engine.process(n_samples, output0, output1, output0, output1);
+    else
+        engine.process(n_samples, output0, output0);
 }
 
 void Ximpulseloader::connect_all__ports(uint32_t port, void* data)
@@ -424,6 +558,8 @@ Ximpulseloader::instantiate(const LV2_Descriptor* descriptor,
         lv2_log_logger_init(&self->logger, self->map, self->log);
     }
 
+    lv2_log_note(&self->logger, "using %s convolution kernels\n", simd::levelName());
+
     if (!self->schedule) {
         lv2_log_error(&self->logger, "Missing feature work:schedule.\n");
     }
@@ -442,6 +578,7 @@ Ximpulseloader::instantiate(const LV2_Descriptor* descriptor,
             if (o->context == LV2_OPTIONS_INSTANCE &&
               o->key == bufsz_ && o->type == atom_Int) {
                 bufsize = *(const int32_t*)o->value;
+                self->nominalSize = true;
             } else if (o->context == LV2_OPTIONS_INSTANCE &&
               o->key == bufsz_max && o->type == atom_Int) {
                 if (!bufsize)
@@ -458,11 +595,22 @@ Ximpulseloader::instantiate(const LV2_Descriptor* descriptor,
         if (bufsize == 0) {
             lv2_log_error(&self->logger, "No maximum buffer size given.\n");
         } else {
-            self->engine.bufsize = bufsize;
+            self->engine.set_buffersize(bufsize);
             lv2_log_note(&self->logger, "using block size: %d\n", bufsize);
         }
     }
 
+    // the stereo plugin handle stereo and true stereo IR files,
+    // the mono in, stereo out plugin route the input to both channels
+    if (!strcmp(descriptor->URI, PLUGIN_STEREO_URI)) {
+        self->stereo = true;
+        self->engine.set_channels(2, 2);
+    } else if (!strcmp(descriptor->URI, PLUGIN_MONO_STEREO_URI)) {
+        self->stereo = true;
+        self->monoIn = true;
+        self->engine.set_channels(1, 2);
+    }
+
     self->map_uris(self->map);
     lv2_atom_forge_init(&self->forge, self->map);
     self->init_dsp_((uint32_t)rate);
@@ -521,10 +669,38 @@ LV2_Worker_Status Ximpulseloader::work_response(LV2_Handle instance,
   return LV2_WORKER_SUCCESS;
 }
 
+uint32_t Ximpulseloader::get_options(LV2_Handle instance, LV2_Options_Option* options)
+{
+    // we don't provide any options
+    return LV2_OPTIONS_ERR_BAD_KEY;
+}
+
+// the host changed the block size, run() let the worker plan the
+// partitions again from the cached IR
+uint32_t Ximpulseloader::set_options(LV2_Handle instance, const LV2_Options_Option* options)
+{
+    Ximpulseloader* self = static_cast<Ximpulseloader*>(instance);
+    uint32_t status = LV2_OPTIONS_SUCCESS;
+    for (const LV2_Options_Option* o = options; o->key; ++o) {
+        if (o->context != LV2_OPTIONS_INSTANCE) continue;
+        const bool nominal = o->key == self->bufsz_nominalBlockLength;
+        if (!nominal && o->key != self->bufsz_maxBlockLength) {
+            status |= LV2_OPTIONS_ERR_BAD_KEY;
+        } else if (o->type != self->atom_Int || *(const int32_t*)o->value <= 0) {
+            status |= LV2_OPTIONS_ERR_BAD_VALUE;
+        } else if (nominal || !self->nominalSize) {
+            self->nominalSize |= nominal;
+            self->engine.set_buffersize(*(const int32_t*)o->value);
+        }
+    }
+    return status;
+}
+
 const void* Ximpulseloader::extension_data(const char* uri)
 {
     static const LV2_Worker_Interface worker = { work, work_response, NULL };
     static const LV2_State_Interface  state  = { save_state, restore_state };
+    static const LV2_Options_Interface options = { get_options, set_options };
 
     if (!strcmp(uri, LV2_WORKER__interface)) {
         return &worker;
@@ -532,6 +708,9 @@ const void* Ximpulseloader::extension_data(const char* uri)
     else if (!strcmp(uri, LV2_STATE__interface)) {
         return &state;
     }
+    else if (!strcmp(uri, LV2_OPTIONS__interface)) {
+        return &options;
+    }
 
     return NULL;
 }
@@ -548,6 +727,30 @@ const LV2_Descriptor Ximpulseloader::descriptor =
     Ximpulseloader::extension_data
 };
 
+const LV2_Descriptor Ximpulseloader::descriptorStereo =
+{
+    PLUGIN_STEREO_URI ,
+    Ximpulseloader::instantiate,
+    Ximpulseloader::connect_port,
+    Ximpulseloader::activate,
+    Ximpulseloader::run,
+    Ximpulseloader::deactivate,
+    Ximpulseloader::cleanup,
+    Ximpulseloader::extension_data
+};
+
+const LV2_Descriptor Ximpulseloader::descriptorMonoStereo =
+{
+    PLUGIN_MONO_STEREO_URI ,
+    Ximpulseloader::instantiate,
+    Ximpulseloader::connect_port,
+    Ximpulseloader::activate,
+    Ximpulseloader::run,
+    Ximpulseloader::deactivate,
+    Ximpulseloader::cleanup,
+    Ximpulseloader::extension_data
+};
+
 } // end namespace impulseloader
 
 ////////////////////////// LV2 SYMBOL EXPORT ///////////////////////////
@@ -560,6 +763,10 @@ lv2_descriptor(uint32_t index)
     {
         case 0:
             return &impulseloader::Ximpulseloader::descriptor;
+        case 1:
+            return &impulseloader::Ximpulseloader::descriptorStereo;
+        case 2:
+            return &impulseloader::Ximpulseloader::descriptorMonoStereo;
         default:
             return NULL;
     }
@@ -59,6 +59,7 @@ static inline LV2_Atom* write_set_file(const LV2_URID urid, LV2_Atom_Forge* forg
 }
 
 void sendValueChanged(X11_UI *ui, int port, float value) {
+    if (port > 9) port -= ui->itf.portShift;
     ui->itf.write_function(ui->itf.controller, port,sizeof(float),0,&value);
 }
 
@@ -182,6 +183,23 @@ void plugin_port_event(LV2UI_Handle handle, uint32_t port_index,
     }
     // port value change message from host
     // do special stuff when needed
+    if (format == 0) {
+        X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+        const float value = *(const float*)buffer;
+        if (port_index == 11 && ps->irLength != value) {
+            ps->irLength = value;
+            expose_widget(ui->win);
+        } else if (port_index == 12 && ps->irSaving != value) {
+            ps->irSaving = value;
+            expose_widget(ui->win);
+        } else if (port_index == 18 && ps->misses != value) {
+            ps->misses = value;
+            expose_widget(ui->win);
+        } else if (port_index == 19 && ps->adaptations != value) {
+            ps->adaptations = value;
+            expose_widget(ui->win);
+        }
+    }
 }
 
 /*---------------------------------------------------------------------
@@ -208,6 +226,9 @@ static LV2UI_Handle instantiate(const LV2UI_Descriptor * descriptor,
 
     ui->parentXwindow = 0;
     ui->private_ptr = NULL;
+    // the mono plugin lack in1 and out1, the mono in, stereo out plugin in1
+    ui->itf.portShift = strcmp(plugin_uri, XLV2__STEREO) == 0 ? 0 :
+                        strcmp(plugin_uri, XLV2__MONO_STEREO) == 0 ? 1 : 2;
     ui->need_resize = 1;
     ui->loop_counter = 4;
     ui->uiKnowSampleRate = false;
@@ -314,6 +335,7 @@ static void port_event(LV2UI_Handle handle, uint32_t port_index,
                         const void * buffer) {
     X11_UI* ui = (X11_UI*)handle;
     float value = *(float*)buffer;
+    if (port_index > 7) port_index += ui->itf.portShift;
     int i=0;
     for (;i<CONTROLS;i++) {
         if (ui->widget[i] && port_index == (uint32_t)ui->widget[i]->data) {
@@ -44,6 +44,8 @@
 
 #define XLV2__IRFILE "urn:brummer:ImpulseLoader#irfile"
 #define XLV2__GUI "urn:brummer:ImpulseLoader#gui"
+#define XLV2__STEREO "urn:brummer:ImpulseLoader#stereo"
+#define XLV2__MONO_STEREO "urn:brummer:ImpulseLoader#mono_stereo"
 
 #define OBJ_BUF_SIZE 1024
 
@@ -78,6 +80,9 @@ extern "C" {
 
 struct Interface {
     LV2_URID_Map* map;
+    // the mono plugin lack the ports 8 and 9, the controls use
+    // the port index of the stereo plugin
+    uint32_t portShift;
     void *controller;
     LV2UI_Write_Function write_function;
     LV2UI_Resize* resize;
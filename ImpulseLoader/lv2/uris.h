@@ -26,6 +26,8 @@
 
 
 #define PLUGIN_URI "urn:brummer:ImpulseLoader"
+#define PLUGIN_STEREO_URI "urn:brummer:ImpulseLoader#stereo"
+#define PLUGIN_MONO_STEREO_URI "urn:brummer:ImpulseLoader#mono_stereo"
 #define PLUGIN_UI_URI "urn:brummer:ImpulseLoader_ui"
 
 #define XLV2__IRFILE "urn:brummer:ImpulseLoader#irfile"
@@ -67,6 +69,8 @@ public:
     LV2_URID                     patch_Set;
     LV2_URID                     patch_property;
     LV2_URID                     patch_value;
+    LV2_URID                     bufsz_maxBlockLength;
+    LV2_URID                     bufsz_nominalBlockLength;
 
     inline void map_uris(LV2_URID_Map* map) {
         xlv2_ir_file =          map->map(map->handle, XLV2__IRFILE);
@@ -85,6 +89,9 @@ public:
         patch_Set =             map->map(map->handle, LV2_PATCH__Set);
         patch_property =        map->map(map->handle, LV2_PATCH__property);
         patch_value =           map->map(map->handle, LV2_PATCH__value);
+        bufsz_maxBlockLength =  map->map(map->handle, LV2_BUF_SIZE__maxBlockLength);
+        bufsz_nominalBlockLength = map->map(map->handle,
+                                "http://lv2plug.in/ns/ext/buf-size#nominalBlockLength");
     }
 
 };
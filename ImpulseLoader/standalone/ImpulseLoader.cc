@@ -35,6 +35,8 @@ public:
     ImpulseLoader() : engine() {
         workToDo.store(false, std::memory_order_release);
         processCounter = 0;
+        latency = 0;
+        latencyChanged = nullptr;
         settingsHaveChanged = false;
         disableAutoConnect = false;
         s_time = 0.0;
@@ -51,6 +53,7 @@ public:
         for(int i = 0;i<CONTROLS;i++)
             ui->widget[i] = NULL;
         getConfigFilePath();
+        fprintf(stderr, "ImpulseLoader: using %s convolution kernels\n", simd::levelName());
     }
 
     ~ImpulseLoader() {
@@ -136,10 +139,26 @@ public:
         adj_set_value(ui->widget[2]->adj, static_cast<float>(on));
     }
 
+    // the block size from the server, the partitions are planned for it
+    void setBufferSize(uint32_t size) {
+        engine.set_buffersize(size);
+    }
+
     inline void process(uint32_t n_samples, float* output) {
         if (processCounter > 2) engine.process(n_samples, output, output);
     }
 
+    // the latency of the selected latency mode
+    void getLatency(uint32_t* latency_) {
+        (*latency_) = engine.get_latency();
+    }
+
+    // called from the GUI thread when the latency mode changed,
+    // the server then ask for the port latencies again
+    void setLatencyCallback(void (*callback)()) {
+        latencyChanged = callback;
+    }
+
 
     // send value changes from GUI to the engine
     void sendValueChanged(int port, float value) {
@@ -156,10 +175,40 @@ public:
             break;
             case 7:
                 engine.normA = static_cast<uint32_t>(value);
+            break;
+            case 10:
+                engine.trimA = static_cast<uint32_t>(value);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 13:
+                engine.minphaseA = static_cast<uint32_t>(value);
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 14:
+                engine.irGainA = value;
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 15:
+                engine.delayA = value;
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 16:
+                engine.offsetA = value;
+                engine._cd.store(1, std::memory_order_relaxed);
+                workToDo.store(true, std::memory_order_release);
+            break;
+            case 17:
+                engine.lengthA = value;
                 engine._cd.store(1, std::memory_order_relaxed);
-                engine.conv.set_normalisation(engine.normA);
                 workToDo.store(true, std::memory_order_release);
             break;
+            case 20:
+                engine.latencyA = static_cast<uint32_t>(value);
+            break;
             default:
             break;
         }
@@ -228,10 +277,10 @@ public:
                     if (key.compare("[Preset]") == 0) LoadName = remove_sub(line, "[Preset] ");
                     if (name.compare(LoadName) == 0) {
                         if (key.compare("[CONTROLS]") == 0) {
+                            // older presets hold less values
                             for (int i = 0; i < CONTROLS; i++) {
                                 adj_set_value(ui->widget[i]->adj, check_stod(value));
-                                if (!buf) break;
-                                buf >> value;
+                                if (!(buf >> value)) break;
                             }
                         } else if (key.compare("[IrFile]") == 0) {
                             engine.ir_file = remove_sub(line, "[IrFile] ");
@@ -284,6 +333,8 @@ private:
     Widget_t*               ShowValues;
     Widget_t*               AutoConnect;
     int                     processCounter;
+    uint32_t                latency;
+    void                    (*latencyChanged)();
     bool                    settingsHaveChanged;
     bool                    disableAutoConnect;
     std::atomic<bool>       workToDo;
@@ -538,10 +589,10 @@ private:
                     if (key.compare("[Preset]") == 0) LoadName = remove_sub(line, "[Preset] ");
                     if (name.compare(LoadName) == 0) {
                         if (key.compare("[CONTROLS]") == 0) {
+                            // older presets hold less values
                             for (int i = 0; i < CONTROLS; i++) {
                                 adj_set_value(ui->widget[i]->adj, check_stod(value));
-                                if (!buf) break;
-                                buf >> value;
+                                if (!(buf >> value)) break;
                             }
                         } else if (key.compare("[IrFile]") == 0) {
                             engine.ir_file = remove_sub(line, "[IrFile] ");
@@ -655,6 +706,15 @@ private:
             processCounter++;
             return;
         }
+        // plan the partitions again when the block size changed
+        if (engine.replan()) {
+            engine._cd.store(1, std::memory_order_relaxed);
+            workToDo.store(true, std::memory_order_release);
+        }
+        if (latency != engine.get_latency()) {
+            latency = engine.get_latency();
+            if (latencyChanged) latencyChanged();
+        }
         if (workToDo.load(std::memory_order_acquire)) {
             if (engine.xrworker.getProcess()) {
                 workToDo.store(false, std::memory_order_release);
@@ -669,6 +729,8 @@ private:
             #endif
             X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
             get_file(engine.ir_file, &ps->ir);
+            ps->irLength = engine.irLength.load(std::memory_order_relaxed);
+            ps->irSaving = engine.irSaving.load(std::memory_order_relaxed);
             expose_widget(ui->win);
             engine._cd.store(0, std::memory_order_release);
             #if defined(__linux__) || defined(__FreeBSD__) || \
@@ -676,6 +738,25 @@ private:
             XFlush(ui->main.dpy);
             XUnlockDisplay(ui->main.dpy);
             #endif
+        } else {
+            // the missed deadlines are counted in the process thread
+            X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+            const float misses = static_cast<float>(engine.misses.load(std::memory_order_relaxed));
+            const float adaptations = static_cast<float>(engine.adaptations.load(std::memory_order_relaxed));
+            if (ps->misses != misses || ps->adaptations != adaptations) {
+                #if defined(__linux__) || defined(__FreeBSD__) || \
+                    defined(__NetBSD__) || defined(__OpenBSD__)
+                XLockDisplay(ui->main.dpy);
+                #endif
+                ps->misses = misses;
+                ps->adaptations = adaptations;
+                expose_widget(ui->win);
+                #if defined(__linux__) || defined(__FreeBSD__) || \
+                    defined(__NetBSD__) || defined(__OpenBSD__)
+                XFlush(ui->main.dpy);
+                XUnlockDisplay(ui->main.dpy);
+                #endif
+            }
         }
     }
 
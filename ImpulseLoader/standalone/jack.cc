@@ -44,9 +44,32 @@ int jack_srate_callback(jack_nframes_t samplerate, void* arg) {
 
 int jack_buffersize_callback(jack_nframes_t nframes, void* arg) {
     fprintf (stderr, "Buffersize is %i samples \n", nframes);
+    r->setBufferSize(nframes);
     return 0;
 }
 
+// the output is late by the latency of the latency mode
+void jack_latency_callback(jack_latency_callback_mode_t mode, void* arg) {
+    uint32_t latency = 0;
+    r->getLatency(&latency);
+    jack_latency_range_t range;
+    if (mode == JackCaptureLatency) {
+        jack_port_get_latency_range(in_port, mode, &range);
+        range.min += latency;
+        range.max += latency;
+        jack_port_set_latency_range(out_port, mode, &range);
+    } else {
+        jack_port_get_latency_range(out_port, mode, &range);
+        range.min += latency;
+        range.max += latency;
+        jack_port_set_latency_range(in_port, mode, &range);
+    }
+}
+
+void jack_latency_changed() {
+    if (client) jack_recompute_total_latencies(client);
+}
+
 void process_midi(void* midi_input_port_buf) {
     jack_midi_event_t in_event;
     jack_nframes_t event_count = jack_midi_get_event_count(midi_input_port_buf);
@@ -128,6 +151,7 @@ void startJack() {
         jack_set_sample_rate_callback(client, jack_srate_callback, 0);
         jack_set_buffer_size_callback(client, jack_buffersize_callback, 0);
         jack_set_process_callback(client, jack_process, 0);
+        jack_set_latency_callback(client, jack_latency_callback, 0);
         jack_on_shutdown (client, jack_shutdown, 0);
 
         if (jack_activate (client)) {
@@ -141,6 +165,7 @@ void startJack() {
             fprintf (stderr, "jack running with realtime priority\n");
         }
         r->enableEngine(1);
+        r->setLatencyCallback(jack_latency_changed);
         r->readConfig();
         connectPorts();
         runProcess = true;
@@ -0,0 +1,173 @@
+/*
+ * ImpulseLoaderCache.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2025 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** ImpulseLoaderCache - pre-build the on-disk IR cache for a IR library,
+ *                       so the plugins could load the prepared IR data
+ *                       and partition spectra directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "fftconvolver.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options] file|directory ...\n"
+        "  -r rates   comma separated sample rates (default 48000)\n"
+        "  -b sizes   comma separated host block sizes (default 256)\n"
+        "  -t         build for the trimmed IR as well\n"
+        "  -m         build for the minimum phase IR as well\n"
+        "  -s         build for the stereo plugin as well\n"
+        "  -p         measure the convolver costs for the planner again\n"
+        "  -c         clear the cache and exit\n"
+        "FFT backend: %s, cache directory: %s\n", name, fft::backendName(),
+        IrCache::cacheDir().c_str());
+}
+
+static std::vector<uint32_t> parseList(const char* arg) {
+    std::vector<uint32_t> list;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) end = s.size();
+        const long v = strtol(s.substr(pos, end - pos).c_str(), nullptr, 10);
+        if (v > 0) list.push_back(static_cast<uint32_t>(v));
+        pos = end + 1;
+    }
+    return list;
+}
+
+static bool isIrFile(const std::string& name) {
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos) return false;
+    const std::string ext = name.substr(dot + 1);
+    return ext == "wav" || ext == "WAV";
+}
+
+// collect the IR files, directories are searched recursive
+static void collect(const std::string& path, std::vector<std::string>* files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        fprintf(stderr, "Unable to open %s\n", path.c_str());
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        files->push_back(path);
+        return;
+    }
+    DIR* d = opendir(path.c_str());
+    if (!d) return;
+    struct dirent* e;
+    while ((e = readdir(d)) != nullptr) {
+        if (e->d_name[0] == '.') continue;
+        const std::string p = path + "/" + e->d_name;
+        if (stat(p.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) collect(p, files);
+        else if (isIrFile(e->d_name)) files->push_back(p);
+    }
+    closedir(d);
+}
+
+// build for the shapes so far, with and without the flag
+static void addShape(std::vector<uint32_t>* shapes, uint32_t flag) {
+    const size_t n = shapes->size();
+    for (size_t i = 0; i < n; i++) shapes->push_back((*shapes)[i] | flag);
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<uint32_t> rates = {48000};
+    std::vector<uint32_t> sizes = {256};
+    std::vector<uint32_t> shapes = {0};
+    std::vector<uint32_t> layouts = {1};
+    int opt;
+    bool calibrate = false;
+    while ((opt = getopt(argc, argv, "r:b:ntmspch")) != -1) {
+        switch (opt) {
+            case 'r': rates = parseList(optarg); break;
+            case 'b': sizes = parseList(optarg); break;
+            // both normalisation modes use the same cache entries now
+            case 'n': break;
+            case 't': addShape(&shapes, IR_TRIM); break;
+            case 'm': addShape(&shapes, IR_MINPHASE); break;
+            case 's': layouts = {1, 2}; break;
+            case 'p': calibrate = true; break;
+            case 'c':
+                fprintf(stderr, "removed %i files from %s\n",
+                    IrCache::clearDisk(), IrCache::cacheDir().c_str());
+                return 0;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if ((optind >= argc && !calibrate) || rates.empty() || sizes.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    simd::init();
+    if (!IrCache::instance().diskCache() || IrCache::cacheDir().empty()) {
+        fprintf(stderr, "the on-disk cache is disabled\n");
+        return 1;
+    }
+    if (calibrate) {
+        Planner::instance().calibrate();
+        fprintf(stderr, "planner calibration stored in %s\n", Planner::calibrationFile().c_str());
+        double mean = 0.0;
+        uint64_t max = 0;
+        ThreadPool::instance().handoff(ThreadPool::REALTIME, &mean, &max);
+        fprintf(stderr, "thread pool hand over: mean %.1f us, max %.1f us\n", mean * 0.001, max * 0.001);
+        if (optind >= argc) return 0;
+    }
+
+    std::vector<std::string> files;
+    for (int i = optind; i < argc; i++) collect(argv[i], &files);
+
+    int failed = 0;
+    for (const std::string& file : files) {
+        const auto start = std::chrono::steady_clock::now();
+        bool ok = true;
+        for (uint32_t rate : rates) {
+            for (uint32_t size : sizes) {
+                for (uint32_t shape : shapes) {
+                    for (uint32_t channels : layouts) {
+                        // run the same path as the engine does
+                        ConvolverSelector conv;
+                        conv.set_shape(shape);
+                        conv.set_samplerate(rate);
+                        conv.set_buffersize(size);
+                        conv.set_channels(channels, channels);
+                        if (!conv.configure(file, 1.0, 0, 0, 0, 0, 0)) ok = false;
+                        conv.stop_process();
+                        conv.cleanup();
+                        // keep the memory use low, anything is on disk now
+                        IrCache::instance().clear();
+                    }
+                }
+            }
+        }
+        const double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%s %s (%.1f ms)\n", ok ? "cached" : "failed", file.c_str(), ms);
+        if (!ok) failed++;
+    }
+    fprintf(stderr, "%i files, %i failed, cache directory %s\n",
+        static_cast<int>(files.size()), failed, IrCache::cacheDir().c_str());
+    return failed ? 1 : 0;
+}
@@ -24,10 +24,19 @@ typedef struct ERect {
     short right;
 } ERect;
 
+// build with -DIS_STEREO for the stereo/true stereo version
+#ifdef IS_STEREO
+#define PLUGIN_UID 'Irbs'
+#define PLUGIN_NAME "ImpulseLoaderStereo"
+#define PLUGIN_CHANNELS 2
+#else
 #define PLUGIN_UID 'Irbr'
+#define PLUGIN_NAME "ImpulseLoader"
+#define PLUGIN_CHANNELS 1
+#endif
 
 #define WINDOW_WIDTH  500
-#define WINDOW_HEIGHT 309
+#define WINDOW_HEIGHT 389
 
 #define FlagsChunks (1 << 5)
 
@@ -37,6 +46,7 @@ typedef struct ERect {
 
 struct plugin_t {
     AEffect* effect;
+    audioMasterCallback audioMaster;
     ImpulseLoader *r;
     ERect editorRect;
     int width, height;
@@ -71,8 +81,16 @@ static void processReplacing(AEffect* effect, float** inputs, float** outputs, i
     float* output = outputs[0];
     if(output != input)
         memcpy(output, input, sampleFrames*sizeof(float));
-    
+#ifdef IS_STEREO
+    float* input1 = inputs[1];
+    float* output1 = outputs[1];
+    if(output1 != input1)
+        memcpy(output1, input1, sampleFrames*sizeof(float));
+
+    plug->r->process(sampleFrames, output, output1, output, output1);
+#else
     plug->r->process(sampleFrames, output, output);
+#endif
 }
 
 /****************************************************************
@@ -91,6 +109,19 @@ void loadState(plugin_t* plug, int size, int isBank) {
     plug->r->readState(plug->state);
 }
 
+/****************************************************************
+ ** Latency reporting, the host read it on resume
+ */
+
+static void updateLatency(plugin_t* plug) {
+    uint32_t latency = 0;
+    plug->r->getLatency(&latency);
+    if (plug->effect->initialDelay == static_cast<int>(latency)) return;
+    plug->effect->initialDelay = static_cast<int>(latency);
+    if (plug->audioMaster)
+        plug->audioMaster(plug->effect, audioMasterIOChanged, 0, 0, nullptr, 0.0f);
+}
+
 /****************************************************************
  ** The Dispatcher
  */
@@ -102,7 +133,7 @@ static intptr_t dispatcher(AEffect* effect, int32_t opCode, int32_t index, intpt
             if (ptr) *(ERect**)ptr = &plug->editorRect;
             return 1;
         case effGetEffectName:
-            strncpy((char*)ptr, "ImpulseLoader", VestigeMaxNameLen - 1);
+            strncpy((char*)ptr, PLUGIN_NAME, VestigeMaxNameLen - 1);
             ((char*)ptr)[VestigeMaxNameLen - 1] = '\0';
             return 1;
         case effGetVendorString:
@@ -133,6 +164,12 @@ static intptr_t dispatcher(AEffect* effect, int32_t opCode, int32_t index, intpt
             plug->isInited = true;
             loadState(plug, 0, 0);
             break;
+        case effSetBlockSize:
+            plug->r->setBufferSize(static_cast<uint32_t>(value));
+            break;
+        case effMainsChanged:
+            if (value) updateLatency(plug);
+            break;
         case effEditOpen: {
             Window hostWin = (Window)(size_t)ptr;
             plug->r->startGui();
@@ -179,8 +216,10 @@ AEffect* VSTPluginMain(audioMasterCallback audioMaster) {
     plugin_t* plug = (plugin_t*)calloc(1, sizeof(plugin_t));
     AEffect* effect = (AEffect*)calloc(1, sizeof(AEffect));
     plug->r = new ImpulseLoader();
+    plug->r->setChannels(PLUGIN_CHANNELS, PLUGIN_CHANNELS);
     effect->object = plug;
     plug->effect = effect;
+    plug->audioMaster = audioMaster;
     plug->width = WINDOW_WIDTH;
     plug->height = WINDOW_HEIGHT;
     plug->editorRect = {0, 0, (short) plug->height, (short) plug->width};
@@ -195,9 +234,10 @@ AEffect* VSTPluginMain(audioMasterCallback audioMaster) {
     effect->getParameter = getParameter;
     effect->numPrograms = 1;
     effect->numParams = 0;
-    effect->numInputs = 1;
-    effect->numOutputs = 1;
+    effect->numInputs = PLUGIN_CHANNELS;
+    effect->numOutputs = PLUGIN_CHANNELS;
     effect->flags = effFlagsHasEditor | effFlagsCanReplacing | FlagsChunks;
     effect->uniqueID = PLUGIN_UID;
+    effect->initialDelay = 0;
     return effect;
 }